@@ -0,0 +1,742 @@
+/*
+  ==============================================================================
+
+    NN_Benchmark: times the stages of nnAudioProcessor::processBlock in
+    isolation, in nanoseconds per sample, for block sizes 16 to 4096.
+
+    NN_Benchmark [--format csv|json] [--output file] [--seconds s]
+
+    Every stage runs the same kernel the plugin runs on the same data layout,
+    so a slower number after a JUCE update or a code change points at the
+    stage that regressed. Results go to stdout or --output, one row per
+    stage, variant and block size.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/CircularBuffer.h"
+#include "../../Source/BiquadBank.h"
+#include "../../Source/FDNCore.h"
+#include "../../Source/PartitionedConvolution.h"
+#include "../../Source/HybridSplit.h"
+#include "../../Source/OutputStage.h"
+
+#define delaySize 4
+#define bandSize 11
+
+namespace
+{
+    struct Result
+    {
+        juce::String stage;
+        juce::String variant;
+        int blockSize;
+        double nsPerSample;
+        // signal to error ratio in dB where a stage approximates something, NaN otherwise
+        double accuracyDb = std::numeric_limits<double>::quiet_NaN();
+    };
+
+    constexpr double sampleRate = 48000.0;
+    constexpr int delays[delaySize] = { 2003, 2011, 4049, 4051 };
+
+    juce::Array<int> getBlockSizes()
+    {
+        juce::Array<int> sizes;
+        for (int size = 16; size <= 4096; size *= 2)
+            sizes.add(size);
+        return sizes;
+    }
+
+    // gentle peaks below unity, the shape of a designed absorption cascade
+    juce::IIRCoefficients getBandCoefficients(int line, int band)
+    {
+        const auto frequency = 31.25 * std::pow(2.0, band);
+        return juce::IIRCoefficients::makePeakFilter(sampleRate, juce::jmin(frequency, 20000.0), 1.0, (float)(0.92 - 0.01 * line));
+    }
+
+    void fillNoise(float* data, int numSamples, juce::Random& random)
+    {
+        for (int i = 0; i < numSamples; i++)
+            data[i] = random.nextFloat() * 2.0f - 1.0f;
+    }
+
+    /** Calls process(blockSize) until roughly minimumSeconds have passed, repeats that five times and
+        returns the fastest run in nanoseconds per sample. The fastest run is the least disturbed one.
+    */
+    template <typename Process>
+    double measure(int blockSize, double minimumSeconds, Process&& process)
+    {
+        const auto ticksPerSecond = (double)juce::Time::getHighResolutionTicksPerSecond();
+
+        // warm caches and let the branch predictors settle
+        for (int i = 0; i < 8; i++)
+            process(blockSize);
+
+        auto best = std::numeric_limits<double>::max();
+
+        for (int run = 0; run < 5; run++)
+        {
+            juce::int64 samples = 0;
+            const auto start = juce::Time::getHighResolutionTicks();
+            auto elapsed = 0.0;
+
+            do
+            {
+                process(blockSize);
+                samples += blockSize;
+                elapsed = (double)(juce::Time::getHighResolutionTicks() - start) / ticksPerSecond;
+            }
+            while (elapsed < minimumSeconds / 5.0);
+
+            best = juce::jmin(best, elapsed * 1.0e9 / (double)samples);
+        }
+
+        return best;
+    }
+}
+
+//==============================================================================
+/** CircularBuffer reads as the delay lines use them: one write and one read per sample. */
+static void benchmarkCircularBuffer(juce::Array<Result>& results, double seconds)
+{
+    CircularBuffer<double> buffer;
+    buffer.createCircularBuffer(4096, 8);
+
+    juce::Random random(1);
+    for (int i = 0; i < 4096; i++)
+        buffer.writeBuffer(random.nextDouble());
+
+    // slowly modulated fractional delay, so the fraction changes every sample
+    double phase = 0.0;
+    auto nextDelay = [&phase]
+    {
+        phase += 0.0001;
+        if (phase >= 1.0)
+            phase -= 1.0;
+        return 2003.0 + 20.0 * phase;
+    };
+
+    volatile double sink = 0.0;
+
+    for (auto blockSize : getBlockSizes())
+    {
+        results.add({ "circular_buffer", "integer", blockSize, measure(blockSize, seconds, [&](int n)
+        {
+            double sum = 0.0;
+            for (int i = 0; i < n; i++)
+            {
+                const auto y = buffer.readBuffer((int)nextDelay());
+                buffer.writeBuffer(y * 0.5);
+                sum += y;
+            }
+            sink = sum;
+        }) });
+
+        results.add({ "circular_buffer", "linear", blockSize, measure(blockSize, seconds, [&](int n)
+        {
+            double sum = 0.0;
+            for (int i = 0; i < n; i++)
+            {
+                const auto y = buffer.doLinearInterpolation((float)nextDelay());
+                buffer.writeBuffer(y * 0.5);
+                sum += y;
+            }
+            sink = sum;
+        }) });
+
+        results.add({ "circular_buffer", "hermite", blockSize, measure(blockSize, seconds, [&](int n)
+        {
+            double sum = 0.0;
+            for (int i = 0; i < n; i++)
+            {
+                const auto y = buffer.doHermitInterpolation((float)nextDelay());
+                buffer.writeBuffer(y * 0.5);
+                sum += y;
+            }
+            sink = sum;
+        }) });
+
+        results.add({ "circular_buffer", "lagrange", blockSize, measure(blockSize, seconds, [&](int n)
+        {
+            double sum = 0.0;
+            for (int i = 0; i < n; i++)
+            {
+                const auto y = buffer.doLagrangeInterpolation((float)nextDelay());
+                buffer.writeBuffer(y * 0.5);
+                sum += y;
+            }
+            sink = sum;
+        }) });
+
+        std::vector<double> block((size_t)blockSize);
+        results.add({ "circular_buffer", "block", blockSize, measure(blockSize, seconds, [&](int n)
+        {
+            // the reference FDN path: chunks no longer than the shortest delay
+            for (int start = 0; start < n; start += delays[0])
+            {
+                const auto numSamples = juce::jmin(delays[0], n - start);
+                buffer.readBlock(delays[0], block.data(), numSamples);
+                buffer.writeBlock(block.data(), numSamples);
+            }
+        }) });
+    }
+}
+
+//==============================================================================
+/** Signal to error ratio of a FractionalDelayTable on 1, 5 and 10 kHz sines read at modulated delays. */
+template <int numTaps>
+static double measureInterpolationAccuracy(const FractionalDelayTable<numTaps>& table)
+{
+    auto signal = [](double t)
+    {
+        const auto w = juce::MathConstants<double>::twoPi / sampleRate;
+        return std::sin(w * 1000.0 * t) + std::sin(w * 5000.0 * t + 1.0) + std::sin(w * 10000.0 * t + 2.0);
+    };
+
+    CircularBuffer<double> buffer;
+    buffer.createCircularBuffer(4096, 8);
+
+    constexpr int numSamples = 256;
+    std::vector<float> positions(numSamples);
+    std::vector<double> output(numSamples);
+    juce::Random random(7);
+    double signalEnergy = 0.0, errorEnergy = 0.0;
+
+    int time = 0;
+    for (; time < 2048; time++)
+        buffer.writeBuffer(signal(time));
+
+    for (int block = 0; block < 32; block++)
+    {
+        for (auto& position : positions)
+            position = 300.0f + 200.0f * random.nextFloat();
+
+        buffer.readInterpolatedBlock(positions.data(), output.data(), numSamples, table);
+
+        // sample i is read i writes later, from the same position back
+        for (int i = 0; i < numSamples; i++)
+        {
+            const auto exact = signal(time + i - (double)positions[(size_t)i]);
+            signalEnergy += exact * exact;
+            errorEnergy += (output[(size_t)i] - exact) * (output[(size_t)i] - exact);
+        }
+
+        for (int i = 0; i < numSamples; i++)
+            buffer.writeBuffer(signal(time++));
+    }
+
+    return 10.0 * std::log10(signalEnergy / juce::jmax(errorEnergy, 1.0e-300));
+}
+
+/** Table-driven block reads, at one fractional delay per block and at one per sample. */
+template <int numTaps>
+static void benchmarkInterpolationTable(juce::Array<Result>& results, double seconds, const juce::String& name, const FractionalDelayTable<numTaps>& table)
+{
+    const auto accuracy = measureInterpolationAccuracy(table);
+
+    // long enough for a whole 4096 sample block to come from written samples
+    CircularBuffer<double> buffer;
+    buffer.createCircularBuffer(16384, 8);
+
+    juce::Random random(8);
+    for (int i = 0; i < 16384; i++)
+        buffer.writeBuffer(random.nextDouble() - 0.5);
+
+    std::vector<double> output(4096), noise(4096);
+    std::vector<float> positions(4096);
+    for (auto& x : noise)
+        x = random.nextDouble() - 0.5;
+    for (int i = 0; i < 4096; i++)
+        positions[(size_t)i] = 4200.0f + 20.0f * std::sin(0.001f * (float)i);
+
+    for (auto blockSize : getBlockSizes())
+    {
+        results.add({ "interpolation", name + "_fixed", blockSize, measure(blockSize, seconds, [&](int n)
+        {
+            buffer.readInterpolatedBlock(4200.37, output.data(), n, table);
+            buffer.writeBlock(noise.data(), n);
+        }), accuracy });
+
+        results.add({ "interpolation", name + "_modulated", blockSize, measure(blockSize, seconds, [&](int n)
+        {
+            buffer.readInterpolatedBlock(positions.data(), output.data(), n, table);
+            buffer.writeBlock(noise.data(), n);
+        }), accuracy });
+    }
+}
+
+static void benchmarkInterpolation(juce::Array<Result>& results, double seconds)
+{
+    benchmarkInterpolationTable(results, seconds, "linear", FractionalDelayTable<2>::lagrange());
+    benchmarkInterpolationTable(results, seconds, "hermite", FractionalDelayTable<4>::hermite());
+    benchmarkInterpolationTable(results, seconds, "lagrange3", FractionalDelayTable<4>::lagrange());
+    benchmarkInterpolationTable(results, seconds, "lagrange5", FractionalDelayTable<6>::lagrange());
+}
+
+//==============================================================================
+/** The 4 x 11 absorption cascade, per sample as inside the feedback loop. The juce::IIRFilter
+    variant is the per-line, per-band filter chain the cascade replaced.
+*/
+static void benchmarkFilters(juce::Array<Result>& results, double seconds)
+{
+    BiquadBank<double, delaySize, bandSize> bank;
+    juce::IIRFilter filters[delaySize][bandSize];
+
+    for (int line = 0; line < delaySize; line++)
+    {
+        for (int band = 0; band < bandSize; band++)
+        {
+            bank.setCoefficients(line, band, getBandCoefficients(line, band));
+            filters[line][band].setCoefficients(getBandCoefficients(line, band));
+        }
+    }
+
+    juce::Random random(2);
+    std::vector<float> input(4096);
+    fillNoise(input.data(), 4096, random);
+
+    volatile double sink = 0.0;
+
+    for (auto blockSize : getBlockSizes())
+    {
+        results.add({ "absorption_filters", "biquad_bank", blockSize, measure(blockSize, seconds, [&](int n)
+        {
+            double sum = 0.0;
+            for (int i = 0; i < n; i++)
+            {
+                double lines[delaySize] = { input[i], -input[i], input[i] * 0.5, -input[i] * 0.5 };
+                bank.processSample(lines);
+                sum += lines[0] + lines[3];
+            }
+            sink = sum;
+        }) });
+
+        results.add({ "absorption_filters", "juce_iir_filter", blockSize, measure(blockSize, seconds, [&](int n)
+        {
+            double sum = 0.0;
+            for (int i = 0; i < n; i++)
+            {
+                float lines[delaySize] = { input[i], -input[i], input[i] * 0.5f, -input[i] * 0.5f };
+                for (int line = 0; line < delaySize; line++)
+                    for (int band = 0; band < bandSize; band++)
+                        lines[line] = filters[line][band].processSingleSampleRaw(lines[line]);
+                sum += lines[0] + lines[3];
+            }
+            sink = sum;
+        }) });
+    }
+}
+
+//==============================================================================
+/** Vectorised FDNCore with numLines lines, lengths spread over the range the plugin uses. */
+template <int numLines>
+static void benchmarkFDNCore(juce::Array<Result>& results, double seconds, const std::vector<double>& dryL, const std::vector<double>& dryR,
+                             std::vector<double>& tapL, std::vector<double>& tapR)
+{
+    FDNCore<numLines, bandSize> core;
+
+    std::array<int, numLines> lengths;
+    for (int line = 0; line < numLines; line++)
+        lengths[(size_t)line] = 2003 + (2048 * line) / (numLines - 1);
+
+    core.prepare(lengths);
+
+    for (int line = 0; line < numLines; line++)
+        for (int band = 0; band < bandSize; band++)
+            core.setCoefficients(line, band, getBandCoefficients(line % delaySize, band));
+
+    for (auto blockSize : getBlockSizes())
+    {
+        results.add({ "fdn", "vectorised_" + juce::String(numLines) + "_lines", blockSize, measure(blockSize, seconds, [&](int n)
+        {
+            core.process(dryL.data(), dryR.data(), tapL.data(), tapR.data(), n);
+        }) });
+    }
+}
+
+/** The reference FDN loop of nnAudioProcessor::processBlock (CircularBuffer + BiquadBank, 4 lines) at one precision. */
+template <typename SampleType>
+static void benchmarkFDNReference(juce::Array<Result>& results, double seconds, const juce::String& variant,
+                                  const std::vector<double>& dry)
+{
+    CircularBuffer<SampleType> lines[delaySize];
+    BiquadBank<SampleType, delaySize, bandSize> bank;
+
+    for (auto& line : lines)
+        line.createCircularBuffer(4096, 8);
+
+    for (int line = 0; line < delaySize; line++)
+        for (int band = 0; band < bandSize; band++)
+            bank.setCoefficients(line, band, getBandCoefficients(line, band));
+
+    std::vector<SampleType> dryL(dry.begin(), dry.end()), dryR(dry.rbegin(), dry.rend()), tapL(4096), tapR(4096);
+    std::vector<std::vector<SampleType>> chunks(delaySize, std::vector<SampleType>((size_t)delays[0]));
+    const auto matrixGain = (SampleType)FDNCore<delaySize, bandSize>::getMatrixGain();
+
+    for (auto blockSize : getBlockSizes())
+    {
+        results.add({ "fdn", variant, blockSize, measure(blockSize, seconds, [&](int n)
+        {
+            // mirrors the reference path of nnAudioProcessor::processBlock
+            for (int start = 0; start < n; start += delays[0])
+            {
+                const auto numSamples = juce::jmin(delays[0], n - start);
+
+                for (int line = 0; line < delaySize; line++)
+                    lines[line].readBlock(delays[line], chunks[(size_t)line].data(), numSamples);
+
+                for (int i = 0; i < numSamples; i++)
+                {
+                    SampleType x[delaySize];
+                    for (int line = 0; line < delaySize; line++)
+                        x[line] = chunks[(size_t)line][i];
+
+                    bank.processSample(x);
+
+                    tapL[start + i] = x[0] + x[3];
+                    tapR[start + i] = x[1] + x[2];
+
+                    fastWalshHadamard(x, delaySize);
+                    for (int line = 0; line < delaySize; line++)
+                        chunks[(size_t)line][i] = matrixGain * x[line];
+
+                    chunks[0][i] += dryL[start + i];
+                    chunks[1][i] += dryR[start + i];
+                }
+
+                for (int line = 0; line < delaySize; line++)
+                    lines[line].writeBlock(chunks[(size_t)line].data(), numSamples);
+            }
+        }) });
+    }
+}
+
+/** The whole FDN loop, reference in double and float precision and vectorised (FDNCore, 4 to 16 lines). */
+static void benchmarkFDN(juce::Array<Result>& results, double seconds)
+{
+    juce::Random random(3);
+    std::vector<double> dryL(4096), dryR(4096), tapL(4096), tapR(4096);
+    for (int i = 0; i < 4096; i++)
+    {
+        dryL[i] = random.nextDouble() - 0.5;
+        dryR[i] = random.nextDouble() - 0.5;
+    }
+
+    benchmarkFDNReference<double>(results, seconds, "reference", dryL);
+    benchmarkFDNReference<float>(results, seconds, "reference_float", dryL);
+
+    benchmarkFDNCore<4>(results, seconds, dryL, dryR, tapL, tapR);
+    benchmarkFDNCore<8>(results, seconds, dryL, dryR, tapL, tapR);
+    benchmarkFDNCore<16>(results, seconds, dryL, dryR, tapL, tapR);
+}
+
+//==============================================================================
+/** juce::dsp::Convolution against PartitionedConvolution on a stereo block, for impulse responses of different
+    lengths. The partitioned engine is timed twice: on the audio thread with its tail on the worker, and with
+    every partition on the calling thread, which is its total CPU cost. The benchmark runs faster than real time,
+    so the worker falls behind and the audio thread figure is an upper bound. The hybrid variant is the total cost
+    of the response cut at an 80 ms mixing time plus the crossfade, the network after it is timed by the fdn stage.
+    The saving goes to stderr.
+*/
+static void benchmarkConvolution(juce::Array<Result>& results, double seconds)
+{
+    for (auto irSeconds : { 0.25, 1.0, 2.0, 4.0 })
+    {
+        juce::Random random(4);
+        const auto irLength = (int)(irSeconds * sampleRate);
+
+        // exponentially decaying noise, the shape of a room impulse response
+        juce::AudioBuffer<float> impulseResponse(2, irLength);
+        for (int channel = 0; channel < 2; channel++)
+        {
+            auto* data = impulseResponse.getWritePointer(channel);
+            for (int i = 0; i < irLength; i++)
+                data[i] = (random.nextFloat() * 2.0f - 1.0f) * std::exp(-6.9f * (float)i / (float)irLength);
+        }
+
+        for (auto blockSize : getBlockSizes())
+        {
+            juce::dsp::Convolution convolution;
+            convolution.prepare({ sampleRate, (juce::uint32)blockSize, 2 });
+            convolution.loadImpulseResponse(juce::AudioBuffer<float>(impulseResponse), sampleRate,
+                                            juce::dsp::Convolution::Stereo::yes, juce::dsp::Convolution::Trim::no,
+                                            juce::dsp::Convolution::Normalise::yes);
+
+            juce::AudioBuffer<float> buffer(2, blockSize);
+            auto process = [&](int n)
+            {
+                juce::dsp::AudioBlock<float> block(buffer.getArrayOfWritePointers(), 2, (size_t)n);
+                convolution.process(juce::dsp::ProcessContextReplacing<float>(block));
+            };
+
+            // the engine is built on a background thread and swapped in by process()
+            while (convolution.getCurrentIRSize() == 0)
+            {
+                buffer.clear();
+                process(blockSize);
+                juce::Thread::sleep(1);
+            }
+
+            // and crossfaded in over the next 50 ms
+            for (int i = 0; i < (int)(0.1 * sampleRate) / blockSize + 1; i++)
+                process(blockSize);
+
+            random.setSeed(5);
+            for (int channel = 0; channel < 2; channel++)
+                fillNoise(buffer.getWritePointer(channel), blockSize, random);
+
+            const auto juceCost = measure(blockSize, seconds, process);
+            results.add({ "convolution", "juce_ir_" + juce::String(irLength), blockSize, juceCost });
+
+            double partitionedCost[2] = {};
+            for (auto useBackgroundThread : { true, false })
+            {
+                PartitionedConvolution partitioned;
+                partitioned.setUseBackgroundThread(useBackgroundThread);
+                partitioned.prepare(sampleRate, blockSize);
+                partitioned.loadImpulseResponse(std::make_shared<const juce::AudioBuffer<float>>(impulseResponse), sampleRate);
+
+                const auto cost = measure(blockSize, seconds, [&](int n)
+                {
+                    partitioned.process(buffer.getWritePointer(0), buffer.getWritePointer(1), n);
+                });
+
+                partitionedCost[useBackgroundThread ? 0 : 1] = cost;
+                results.add({ "convolution", juce::String(useBackgroundThread ? "partitioned_audio_thread_ir_" : "partitioned_total_ir_") + juce::String(irLength),
+                              blockSize, cost });
+            }
+
+            // crossfade over the longest line of the 4-line network
+            auto early = impulseResponse;
+            HybridSplit::truncate(early, (int)(0.08 * sampleRate), 4051);
+
+            PartitionedConvolution hybrid;
+            hybrid.setUseBackgroundThread(false);
+            hybrid.prepare(sampleRate, blockSize);
+            hybrid.loadImpulseResponse(std::make_shared<const juce::AudioBuffer<float>>(std::move(early)), sampleRate, false);
+
+            const auto hybridCost = measure(blockSize, seconds, [&](int n)
+            {
+                hybrid.process(buffer.getWritePointer(0), buffer.getWritePointer(1), n);
+            });
+            results.add({ "convolution", "partitioned_hybrid_total_ir_" + juce::String(irLength), blockSize, hybridCost });
+
+            std::cerr << "convolution ir " << irLength << " block " << blockSize << ": juce " << juce::String(juceCost, 1)
+                      << " ns, partitioned audio thread " << juce::String(partitionedCost[0], 1)
+                      << " ns (" << juce::String(100.0 * (1.0 - partitionedCost[0] / juceCost), 0) << "% saved), total "
+                      << juce::String(partitionedCost[1], 1) << " ns (" << juce::String(100.0 * (1.0 - partitionedCost[1] / juceCost), 0) << "% saved), hybrid "
+                      << juce::String(hybridCost, 1) << " ns (" << juce::String(100.0 * (1.0 - hybridCost / juceCost), 0) << "% saved)" << std::endl;
+        }
+    }
+}
+
+//==============================================================================
+/** The final dry / convolution / FDN mix of processBlock: the former loop with parameters read per sample and a
+    double dry copy, against the fused OutputStage with gains ramping on every block, in float and in double precision.
+*/
+static void benchmarkMix(juce::Array<Result>& results, double seconds)
+{
+    juce::AudioParameterFloat level1{ "level1", "Dry", 0.0f, 1.0f, 0.5f };
+    juce::AudioParameterFloat level2{ "level2", "Convolution", 0.0f, 1.0f, 0.5f };
+    juce::AudioParameterFloat level3{ "level3", "FDN", 0.0f, 1.0f, 0.5f };
+
+    juce::Random random(6);
+    std::vector<double> dryL(4096), dryR(4096), bufferL(4096), bufferR(4096), outputDoubleL(4096), outputDoubleR(4096);
+    std::vector<float> convL(4096), convR(4096), outputL(4096), outputR(4096), dryFloatL(4096), dryFloatR(4096);
+    std::vector<float> bufferFloatL(4096), bufferFloatR(4096);
+    for (int i = 0; i < 4096; i++)
+    {
+        dryL[i] = random.nextDouble();
+        dryR[i] = random.nextDouble();
+        bufferL[i] = random.nextDouble();
+        bufferR[i] = random.nextDouble();
+        dryFloatL[i] = (float)dryL[i];
+        dryFloatR[i] = (float)dryR[i];
+        bufferFloatL[i] = (float)bufferL[i];
+        bufferFloatR[i] = (float)bufferR[i];
+    }
+    fillNoise(convL.data(), 4096, random);
+    fillNoise(convR.data(), 4096, random);
+
+    for (auto blockSize : getBlockSizes())
+    {
+        results.add({ "mix", "per_sample_parameters", blockSize, measure(blockSize, seconds, [&](int n)
+        {
+            for (int i = 0; i < n; i++)
+            {
+                outputL[i] = dryL[i] * level1.get() + convL[i] * level2.get() + bufferL[i] * 3.0f * level3.get();
+                outputR[i] = dryR[i] * level1.get() + convR[i] * level2.get() + bufferR[i] * 3.0f * level3.get();
+            }
+        }) });
+
+        OutputStage outputStage;
+        outputStage.reset(level1.get(), level2.get(), 3.0f * level3.get());
+        const float* dryChannels[] = { dryFloatL.data(), dryFloatR.data() };
+        const float* convolutionChannels[] = { convL.data(), convR.data() };
+        const float* networkChannels[] = { bufferFloatL.data(), bufferFloatR.data() };
+        float* outputChannels[] = { outputL.data(), outputR.data() };
+        auto toggle = false;
+
+        results.add({ "mix", "fused_ramped", blockSize, measure(blockSize, seconds, [&](int n)
+        {
+            // a new dry level every block, so the ramp is always running
+            toggle = !toggle;
+            outputStage.process(dryChannels, convolutionChannels, networkChannels, outputChannels, 2, n,
+                                toggle ? level1.get() : 1.0f - level1.get(), level2.get(), 3.0f * level3.get());
+        }) });
+
+        // the double precision host path, where only the convolution arrives in float
+        const double* dryDoubleChannels[] = { dryL.data(), dryR.data() };
+        const double* networkDoubleChannels[] = { bufferL.data(), bufferR.data() };
+        double* outputDoubleChannels[] = { outputDoubleL.data(), outputDoubleR.data() };
+
+        results.add({ "mix", "fused_ramped_double", blockSize, measure(blockSize, seconds, [&](int n)
+        {
+            toggle = !toggle;
+            outputStage.process(dryDoubleChannels, convolutionChannels, networkDoubleChannels, outputDoubleChannels, 2, n,
+                                toggle ? level1.get() : 1.0f - level1.get(), level2.get(), 3.0f * level3.get());
+        }) });
+    }
+}
+
+//==============================================================================
+/** The time-domain chain of one host block of 4096 samples (dry copy, vectorised network, transition
+    filters, mix) run in sub-blocks of blockSize with scratch one sub-block long, as processBlock does.
+    Small sub-blocks keep the scratch in L1 but pay the per-call overhead of every stage more often.
+*/
+static void benchmarkSubBlocks(juce::Array<Result>& results, double seconds)
+{
+    constexpr int hostBlockSize = 4096;
+
+    FDNCore<delaySize, bandSize> core;
+    BiquadBank<float, 2, bandSize> transitionFilters;
+    std::array<int, delaySize> lengths;
+    std::copy(std::begin(delays), std::end(delays), lengths.begin());
+    core.prepare(lengths);
+    for (int band = 0; band < bandSize; band++)
+    {
+        for (int line = 0; line < delaySize; line++)
+            core.setCoefficients(line, band, getBandCoefficients(line, band));
+        transitionFilters.setCoefficients(0, band, getBandCoefficients(0, band));
+        transitionFilters.setCoefficients(1, band, getBandCoefficients(1, band));
+    }
+
+    juce::Random random(7);
+    juce::AudioBuffer<float> host(2, hostBlockSize), output(2, hostBlockSize);
+    for (int channel = 0; channel < 2; channel++)
+        fillNoise(host.getWritePointer(channel), hostBlockSize, random);
+
+    OutputStage outputStage;
+    outputStage.reset(0.5f, 0.5f, 1.5f);
+
+    for (auto blockSize : getBlockSizes())
+    {
+        std::vector<float> dryL((size_t)blockSize), dryR((size_t)blockSize), networkL((size_t)blockSize), networkR((size_t)blockSize);
+
+        results.add({ "sub_blocks", "host_block_" + juce::String(hostBlockSize), blockSize, measure(hostBlockSize, seconds, [&](int n)
+        {
+            for (int start = 0; start < n; start += blockSize)
+            {
+                const auto numSamples = juce::jmin(blockSize, n - start);
+                juce::FloatVectorOperations::copy(dryL.data(), host.getReadPointer(0, start), numSamples);
+                juce::FloatVectorOperations::copy(dryR.data(), host.getReadPointer(1, start), numSamples);
+
+                core.process(dryL.data(), dryR.data(), networkL.data(), networkR.data(), numSamples);
+                float* network[] = { networkL.data(), networkR.data() };
+                transitionFilters.processBlock(network, numSamples);
+
+                // the host input stands in for the convolution, which runs in place on the host buffer
+                const float* dryChannels[] = { dryL.data(), dryR.data() };
+                const float* convolutionChannels[] = { host.getReadPointer(0, start), host.getReadPointer(1, start) };
+                const float* networkChannels[] = { networkL.data(), networkR.data() };
+                float* outputChannels[] = { output.getWritePointer(0, start), output.getWritePointer(1, start) };
+                outputStage.process(dryChannels, convolutionChannels, networkChannels, outputChannels, 2, numSamples, 0.5f, 0.5f, 1.5f);
+            }
+        }) });
+    }
+}
+
+//==============================================================================
+static juce::String toCSV(const juce::Array<Result>& results)
+{
+    juce::String text("stage,variant,block_size,ns_per_sample,accuracy_db\n");
+    for (auto& r : results)
+    {
+        text << r.stage << "," << r.variant << "," << r.blockSize << "," << juce::String(r.nsPerSample, 3) << ",";
+        if (!std::isnan(r.accuracyDb))
+            text << juce::String(r.accuracyDb, 1);
+        text << "\n";
+    }
+    return text;
+}
+
+static juce::String toJSON(const juce::Array<Result>& results)
+{
+    juce::Array<juce::var> rows;
+    for (auto& r : results)
+    {
+        auto* row = new juce::DynamicObject();
+        row->setProperty("stage", r.stage);
+        row->setProperty("variant", r.variant);
+        row->setProperty("block_size", r.blockSize);
+        row->setProperty("ns_per_sample", r.nsPerSample);
+        if (!std::isnan(r.accuracyDb))
+            row->setProperty("accuracy_db", r.accuracyDb);
+        rows.add(juce::var(row));
+    }
+
+    auto* root = new juce::DynamicObject();
+    root->setProperty("juce_version", juce::SystemStats::getJUCEVersion());
+    root->setProperty("cpu", juce::SystemStats::getCpuModel());
+    root->setProperty("sample_rate", sampleRate);
+    root->setProperty("results", rows);
+    return juce::JSON::toString(juce::var(root));
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    juce::ScopedNoDenormals noDenormals;
+
+    juce::String format("csv");
+    juce::File output;
+    double seconds = 0.25;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const juce::String argument(argv[i]);
+        const auto hasValue = i + 1 < argc;
+
+        if (argument == "--format" && hasValue)         format = juce::String(argv[++i]).toLowerCase();
+        else if (argument == "--output" && hasValue)    output = juce::File::getCurrentWorkingDirectory().getChildFile(argv[++i]);
+        else if (argument == "--seconds" && hasValue)   seconds = juce::jmax(0.01, juce::String(argv[++i]).getDoubleValue());
+        else
+        {
+            std::cout << "NN_Benchmark [--format csv|json] [--output <file>] [--seconds <per measurement>]" << std::endl;
+            return 1;
+        }
+    }
+
+    juce::Array<Result> results;
+    benchmarkCircularBuffer(results, seconds);
+    benchmarkInterpolation(results, seconds);
+    benchmarkFilters(results, seconds);
+    benchmarkFDN(results, seconds);
+    benchmarkConvolution(results, seconds);
+    benchmarkMix(results, seconds);
+    benchmarkSubBlocks(results, seconds);
+
+    const auto text = format == "json" ? toJSON(results) : toCSV(results);
+
+    if (output == juce::File())
+        std::cout << text << std::endl;
+    else if (!output.replaceWithText(text))
+    {
+        std::cerr << "cannot write " << output.getFullPathName() << std::endl;
+        return 2;
+    }
+
+    return 0;
+}
@@ -0,0 +1,286 @@
+/*
+  ==============================================================================
+
+    NN_Render: headless offline renderer for nnAudioProcessor.
+
+    NN_Render --ir room.wav --coefficients room.txt [--output dir] [--threads n]
+              [--block n] [--tail seconds] [--hybrid ms] input.wav|directory ...
+    NN_Render --ir room.wav --weights DecayFitNet.weights ...
+
+    Every worker thread owns one processor, prepared once, with the impulse
+    response and the coefficient tensor (see save_coefficients in external.py)
+    loaded up front. Input files are handed out to whichever worker is free and
+    rendered through processBlock as fast as the machine allows. --weights
+    designs the coefficients from the impulse response itself with the
+    native DecayFitNet instead of reading them, no Python needed. --hybrid
+    convolves only up to the given mixing time (0 estimates it) and lets the
+    feedback delay network render the rest.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/PluginProcessor.h"
+#include "../../Source/TraceRecorder.h"
+#include "../../Source/RIRDecodeJob.h"
+#include <fstream>
+
+namespace
+{
+    struct RenderSettings
+    {
+        juce::File impulseResponse;
+        // decoded once in main, every worker's convolution shares the samples
+        std::shared_ptr<const SharedImpulseResponse> decodedImpulseResponse;
+        FilterCoefficientSet coefficients;
+        juce::File outputDirectory;
+        int blockSize = 512;
+        double tailSeconds = 2.0;
+        // seconds, negative convolves the whole response
+        double hybridMixingTime = -1.0;
+    };
+
+    struct RenderTotals
+    {
+        std::atomic<int> filesDone{ 0 };
+        std::atomic<int> filesFailed{ 0 };
+        std::atomic<juce::int64> samplesRendered{ 0 };
+    };
+
+    void printUsage()
+    {
+        std::cout << "NN_Render --ir <rir.wav> (--coefficients <coefficients.txt> | --weights <DecayFitNet.weights>) [--output <dir>] [--threads <n>]\n"
+                     "          [--block <samples>] [--tail <seconds>] [--hybrid <ms, 0 = estimated>] <input.wav | directory> ..." << std::endl;
+    }
+}
+
+//==============================================================================
+class RenderWorker : public juce::Thread
+{
+public:
+    RenderWorker(int index, const RenderSettings& renderSettings, const juce::Array<juce::File>& inputFiles,
+                 std::atomic<int>& nextFileIndex, RenderTotals& renderTotals)
+        : juce::Thread("render worker " + juce::String(index)),
+          settings(renderSettings), files(inputFiles), nextFile(nextFileIndex), totals(renderTotals)
+    {
+        formatManager.registerBasicFormats();
+        // created on the message thread, used only by this worker from here on
+        processor = std::make_unique<nnAudioProcessor>();
+        processor->coefficientRampBlocks = 0;
+        if (settings.hybridMixingTime >= 0.0)
+            processor->setHybridMode(true, settings.hybridMixingTime);
+    }
+
+    // seconds of audio this worker rendered, read once the thread has exited
+    double getAudioSeconds() const noexcept     { return audioSecondsRendered; }
+
+    void run() override
+    {
+        for (auto index = nextFile++; index < files.size() && !threadShouldExit(); index = nextFile++)
+        {
+            if (render(files.getReference(index)))
+                ++totals.filesDone;
+            else
+                ++totals.filesFailed;
+        }
+    }
+
+private:
+    void prepare(double sampleRate)
+    {
+        if (sampleRate == preparedSampleRate)
+            return;
+
+        processor->setPlayConfigDetails(2, 2, sampleRate, settings.blockSize);
+        processor->prepareToPlay(sampleRate, settings.blockSize);
+        // coefficients first, the hybrid split levels the network against them
+        processor->publishCoefficients(settings.coefficients);
+        processor->loadImpulseResponse(settings.impulseResponse, settings.decodedImpulseResponse);
+
+        // the load runs in the background and its engines take over inside processBlock, fading in over the ones
+        // prepareToPlay rebuilt when there were any, so feed silence until the new response runs on its own
+        juce::AudioBuffer<float> silence(2, settings.blockSize);
+        juce::MidiBuffer midi;
+        while (processor->isLoadingImpulseResponse() && !threadShouldExit())
+        {
+            silence.clear();
+            processor->processBlock(silence, midi);
+            juce::Thread::sleep(1);
+        }
+
+        preparedSampleRate = sampleRate;
+    }
+
+    bool render(const juce::File& input)
+    {
+        std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(input));
+        if (reader == nullptr)
+        {
+            std::cerr << "cannot read " << input.getFullPathName() << std::endl;
+            return false;
+        }
+
+        const auto sampleRate = reader->sampleRate;
+        prepare(sampleRate);
+
+        const auto inputLength = (int)reader->lengthInSamples;
+        const auto totalLength = inputLength + (int)(settings.tailSeconds * sampleRate);
+        const auto sourceChannels = (int)reader->numChannels;
+
+        juce::AudioBuffer<float> source(juce::jmax(1, sourceChannels), inputLength);
+        reader->read(&source, 0, inputLength, 0, true, true);
+
+        juce::AudioBuffer<float> rendered(2, totalLength);
+        juce::AudioBuffer<float> block(2, settings.blockSize);
+        juce::MidiBuffer midi;
+
+        const auto start = juce::Time::getMillisecondCounterHiRes();
+
+        for (int position = 0; position < totalLength; position += settings.blockSize)
+        {
+            const auto numSamples = juce::jmin(settings.blockSize, totalLength - position);
+            const auto numInput = juce::jlimit(0, numSamples, inputLength - position);
+
+            block.setSize(2, numSamples, false, false, true);
+            block.clear();
+            // mono sources feed both inputs
+            for (int channel = 0; channel < 2; channel++)
+                if (numInput > 0)
+                    block.copyFrom(channel, 0, source, juce::jmin(channel, source.getNumChannels() - 1), position, numInput);
+
+            processor->processBlock(block, midi);
+
+            for (int channel = 0; channel < 2; channel++)
+                rendered.copyFrom(channel, position, block, channel, 0, numSamples);
+        }
+
+        const auto seconds = (juce::Time::getMillisecondCounterHiRes() - start) / 1000.0;
+        const auto audioSeconds = totalLength / sampleRate;
+
+        auto output = settings.outputDirectory.getChildFile(input.getFileNameWithoutExtension() + "_nn.wav");
+        output.deleteFile();
+        std::unique_ptr<juce::OutputStream> stream(output.createOutputStream());
+        juce::WavAudioFormat wav;
+        std::unique_ptr<juce::AudioFormatWriter> writer(stream != nullptr ? wav.createWriterFor(stream.get(), sampleRate, 2, 24, {}, 0) : nullptr);
+        if (writer == nullptr)
+        {
+            std::cerr << "cannot write " << output.getFullPathName() << std::endl;
+            return false;
+        }
+        stream.release();   // owned by the writer now
+        writer->writeFromAudioSampleBuffer(rendered, 0, totalLength);
+
+        totals.samplesRendered += totalLength;
+        audioSecondsRendered += audioSeconds;
+
+        std::cout << input.getFileName() << ": " << juce::String(audioSeconds, 2) << " s audio in " << juce::String(seconds, 3)
+                  << " s (" << juce::String(audioSeconds / juce::jmax(seconds, 1e-9), 1) << "x realtime)" << std::endl;
+        return true;
+    }
+
+    const RenderSettings& settings;
+    const juce::Array<juce::File>& files;
+    std::atomic<int>& nextFile;
+    RenderTotals& totals;
+
+    juce::AudioFormatManager formatManager;
+    std::unique_ptr<nnAudioProcessor> processor;
+    double preparedSampleRate = 0.0;
+    double audioSecondsRendered = 0.0;
+};
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    // with NN_TRACE set, the impulse response loads end up in NN_Render.json
+    TraceRecorder::getInstance().setProcessName("NN_Render", 1);
+
+    RenderSettings settings;
+    settings.outputDirectory = juce::File::getCurrentWorkingDirectory();
+    auto numThreads = juce::SystemStats::getNumPhysicalCpus();
+    juce::File coefficientFile;
+    juce::File weightsFile;
+    juce::Array<juce::File> inputs;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const juce::String argument(argv[i]);
+        const auto hasValue = i + 1 < argc;
+
+        if (argument == "--ir" && hasValue)                 settings.impulseResponse = juce::File::getCurrentWorkingDirectory().getChildFile(argv[++i]);
+        else if (argument == "--coefficients" && hasValue)  coefficientFile = juce::File::getCurrentWorkingDirectory().getChildFile(argv[++i]);
+        else if (argument == "--weights" && hasValue)       weightsFile = juce::File::getCurrentWorkingDirectory().getChildFile(argv[++i]);
+        else if (argument == "--output" && hasValue)        settings.outputDirectory = juce::File::getCurrentWorkingDirectory().getChildFile(argv[++i]);
+        else if (argument == "--threads" && hasValue)       numThreads = juce::jmax(1, juce::String(argv[++i]).getIntValue());
+        else if (argument == "--block" && hasValue)         settings.blockSize = juce::jmax(16, juce::String(argv[++i]).getIntValue());
+        else if (argument == "--tail" && hasValue)          settings.tailSeconds = juce::jmax(0.0, juce::String(argv[++i]).getDoubleValue());
+        else if (argument == "--hybrid" && hasValue)        settings.hybridMixingTime = juce::jmax(0.0, juce::String(argv[++i]).getDoubleValue() / 1000.0);
+        else
+        {
+            // a directory contributes every wav directly inside it
+            auto file = juce::File::getCurrentWorkingDirectory().getChildFile(argument);
+            if (file.isDirectory())
+                inputs.addArray(file.findChildFiles(juce::File::findFiles, false, "*.wav"));
+            else if (file.existsAsFile())
+                inputs.add(file);
+            else
+                std::cerr << "skipping " << argument << std::endl;
+        }
+    }
+
+    // read once per run, for the analysis and for the convolution of every render thread
+    settings.decodedImpulseResponse = SharedImpulseResponse::load(settings.impulseResponse, ChannelLayout::maxChannels);
+
+    auto coefficientsLoaded = false;
+    if (weightsFile != juce::File())
+    {
+        // designed for the delay lines the processor runs with
+        DecayFitNet net;
+        const auto delayLines = nnAudioProcessor::makeDelayLines();
+        const auto& rir = settings.decodedImpulseResponse;
+        coefficientsLoaded = rir != nullptr && net.loadWeights(weightsFile)
+                          && RIRDecodeJob::analyse(net, *rir, std::vector<float>(delayLines.begin(), delayLines.end()), settings.coefficients);
+        if (!coefficientsLoaded)
+            std::cerr << "cannot design coefficients from " << settings.impulseResponse.getFullPathName() << " with " << weightsFile.getFullPathName() << std::endl;
+    }
+    else
+    {
+        std::ifstream coefficientStream(coefficientFile.getFullPathName().toStdString());
+        coefficientsLoaded = coefficientStream && settings.coefficients.loadFromText(coefficientStream);
+    }
+
+    if (settings.decodedImpulseResponse == nullptr || !coefficientsLoaded || inputs.isEmpty())
+    {
+        printUsage();
+        return 1;
+    }
+
+    settings.outputDirectory.createDirectory();
+    numThreads = juce::jmin(numThreads, inputs.size());
+
+    RenderTotals totals;
+    std::atomic<int> nextFile{ 0 };
+    juce::OwnedArray<RenderWorker> workers;
+    for (int i = 0; i < numThreads; i++)
+        workers.add(new RenderWorker(i, settings, inputs, nextFile, totals));
+
+    const auto start = juce::Time::getMillisecondCounterHiRes();
+
+    for (auto* worker : workers)
+        worker->startThread();
+    for (auto* worker : workers)
+        worker->waitForThreadToExit(-1);
+
+    const auto seconds = (juce::Time::getMillisecondCounterHiRes() - start) / 1000.0;
+    auto audioSeconds = 0.0;
+    for (auto* worker : workers)
+        audioSeconds += worker->getAudioSeconds();
+
+    std::cout << totals.filesDone.load() << " files rendered, " << totals.filesFailed.load() << " failed, "
+              << numThreads << " threads, " << juce::String(seconds, 2) << " s\n"
+              << "throughput: " << juce::String(totals.filesDone.load() / juce::jmax(seconds, 1e-9) * 3600.0, 0) << " files/hour, "
+              << juce::String(audioSeconds / juce::jmax(seconds, 1e-9), 1) << "x realtime" << std::endl;
+
+    return totals.filesFailed.load() == 0 ? 0 : 2;
+}
@@ -0,0 +1,101 @@
+/*
+  ==============================================================================
+
+    Arena.h
+
+    One cache line aligned block that prepareToPlay carves the delay lines
+    and scratch buffers from, so they sit next to each other instead of
+    wherever the heap put them and nothing is allocated after prepare. The
+    layout code runs twice: the first pass only adds up what it takes, the
+    block is allocated once for that size, and the second pass hands out
+    the same offsets. Buffers that are read at the same time can be started
+    at staggered offsets within the L1 set stride, so lines of similar
+    length do not evict each other.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+class Arena
+{
+public:
+	static constexpr std::size_t cacheLine = 64;
+	// addresses this far apart share an L1 set on current x86 and ARM cores (64 sets of 64 bytes)
+	static constexpr std::size_t setStride = 4096;
+
+	Arena()
+	{
+	};
+
+	~Arena()
+	{
+	};
+
+	/** Calls layout(arena) to measure and again to carve. The block is only reallocated when it is too
+		small, so preparing again with the same settings keeps it. layout has to take the same buffers in
+		both passes and may only touch them when isMeasuring() is false.
+	*/
+	template <typename Layout>
+	void build(Layout&& layout)
+	{
+		measuring = true;
+		used = 0;
+		layout(*this);
+
+		if (used > capacity)
+		{
+			storage.reset(new char[used + cacheLine]);
+			auto address = reinterpret_cast<std::uintptr_t>(storage.get());
+			base = reinterpret_cast<char*>((address + cacheLine - 1) & ~(std::uintptr_t)(cacheLine - 1));
+			capacity = used;
+		}
+
+		// every layout starts from zeroed memory
+		std::fill(base, base + capacity, (char)0);
+
+		measuring = false;
+		used = 0;
+		layout(*this);
+	}
+
+	bool isMeasuring() const noexcept                           { return measuring; }
+
+	/** Zeroed room for count values of T, starting offset bytes after the next cache line.
+		nullptr while measuring.
+	*/
+	template <typename T>
+	T* take(std::size_t count, std::size_t offset = 0) noexcept
+	{
+		static_assert(std::is_trivially_copyable<T>::value && alignof(T) <= cacheLine, "the arena hands out raw memory");
+		jassert(offset % alignof(T) == 0);
+
+		used = (used + cacheLine - 1) & ~(cacheLine - 1);
+		used += offset;
+		auto* result = measuring ? nullptr : reinterpret_cast<T*>(base + used);
+		used += count * sizeof(T);
+
+		jassert(measuring || used <= capacity);
+		return result;
+	}
+
+	/** Offset that spreads the starts of numSiblings buffers evenly over one set stride. */
+	static std::size_t spread(int index, int numSiblings) noexcept
+	{
+		return ((std::size_t)index * setStride / (std::size_t)juce::jmax(1, numSiblings)) & ~(cacheLine - 1);
+	}
+
+	/** Bytes the block holds. */
+	std::size_t getSize() const noexcept                        { return capacity; }
+
+private:
+	std::unique_ptr<char[]> storage;
+	char* base = nullptr;
+	std::size_t capacity = 0;
+	std::size_t used = 0;
+	bool measuring = false;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Arena)
+};
@@ -0,0 +1,199 @@
+/*
+  ==============================================================================
+
+    BiquadBank.h
+
+    Structure-of-arrays biquad cascade. Coefficients and state of every lane
+    and band sit in contiguous aligned arrays laid out [band][lane], so band k
+    of all lanes is one vector operation (transposed direct form II). Lanes
+    are independent channels, e.g. the delay lines of the FDN or the L/R
+    transition filters.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+template <typename SampleType, int numLanes, int numBands>
+class BiquadBank
+{
+public:
+	BiquadBank()
+	{
+		for (auto& band : coefficients)
+			for (auto& c : band)
+				std::fill(std::begin(c), std::end(c), SampleType(0));
+
+		std::copy(&coefficients[0][0][0], &coefficients[0][0][0] + numValues, &targets[0][0][0]);
+		reset();
+	};
+
+	~BiquadBank()
+	{
+	};
+
+	void reset();
+	void setCoefficients(int lane, int band, double b0, double b1, double b2, double a0, double a1, double a2);
+	void setCoefficients(int lane, int band, const juce::IIRCoefficients& coeffs);
+
+	/** Stages new coefficients without touching the running ones, see rampToTargets(). */
+	void setTargetCoefficients(int lane, int band, double b0, double b1, double b2, double a0, double a1, double a2);
+
+	/** Moves the running coefficients to the staged ones over numSteps calls of stepRamp(), or at once for 0.
+		Interpolating (a1, a2) linearly between two stable sections stays inside the stability triangle.
+	*/
+	void rampToTargets(int numSteps);
+	void stepRamp() noexcept;
+
+	/** Runs one sample of every lane through the whole cascade, in place.
+		Use this inside feedback loops where each output is needed before the next input exists.
+	*/
+	void processSample(SampleType* lanes) noexcept;
+
+	/** Runs whole blocks through the cascade band by band, in place.
+		Only valid without a feedback dependency on the output.
+	*/
+	void processBlock(SampleType* const* lanes, int numSamples) noexcept;
+
+private:
+	enum { b0, b1, b2, a1, a2, numCoefficients };
+
+	static constexpr int numValues = numBands * numCoefficients * numLanes;
+
+	static void storeCoefficients(SampleType (&destination)[numBands][numCoefficients][numLanes], int lane, int band,
+		double b0, double b1, double b2, double a0, double a1, double a2);
+
+	alignas(32) SampleType coefficients[numBands][numCoefficients][numLanes];
+	alignas(32) SampleType targets[numBands][numCoefficients][numLanes];
+	alignas(32) SampleType state1[numBands][numLanes];
+	alignas(32) SampleType state2[numBands][numLanes];
+	int rampStepsRemaining = 0;
+};
+
+template <typename SampleType, int numLanes, int numBands>
+void BiquadBank<SampleType, numLanes, numBands>::reset()
+{
+	for (int band = 0; band < numBands; band++)
+	{
+		std::fill(std::begin(state1[band]), std::end(state1[band]), SampleType(0));
+		std::fill(std::begin(state2[band]), std::end(state2[band]), SampleType(0));
+	}
+}
+
+template <typename SampleType, int numLanes, int numBands>
+void BiquadBank<SampleType, numLanes, numBands>::storeCoefficients(SampleType (&destination)[numBands][numCoefficients][numLanes], int lane, int band,
+	double c0, double c1, double c2, double c3, double c4, double c5)
+{
+	jassert(juce::isPositiveAndBelow(lane, numLanes) && juce::isPositiveAndBelow(band, numBands));
+	jassert(c3 != 0.0);
+
+	const auto a0 = 1.0 / c3;
+	destination[band][b0][lane] = SampleType(c0 * a0);
+	destination[band][b1][lane] = SampleType(c1 * a0);
+	destination[band][b2][lane] = SampleType(c2 * a0);
+	destination[band][a1][lane] = SampleType(c4 * a0);
+	destination[band][a2][lane] = SampleType(c5 * a0);
+}
+
+template <typename SampleType, int numLanes, int numBands>
+void BiquadBank<SampleType, numLanes, numBands>::setCoefficients(int lane, int band, double c0, double c1, double c2, double c3, double c4, double c5)
+{
+	storeCoefficients(coefficients, lane, band, c0, c1, c2, c3, c4, c5);
+	storeCoefficients(targets, lane, band, c0, c1, c2, c3, c4, c5);
+}
+
+template <typename SampleType, int numLanes, int numBands>
+void BiquadBank<SampleType, numLanes, numBands>::setTargetCoefficients(int lane, int band, double c0, double c1, double c2, double c3, double c4, double c5)
+{
+	storeCoefficients(targets, lane, band, c0, c1, c2, c3, c4, c5);
+}
+
+template <typename SampleType, int numLanes, int numBands>
+void BiquadBank<SampleType, numLanes, numBands>::rampToTargets(int numSteps)
+{
+	rampStepsRemaining = juce::jmax(0, numSteps);
+
+	if (rampStepsRemaining == 0)
+		std::copy(&targets[0][0][0], &targets[0][0][0] + numValues, &coefficients[0][0][0]);
+}
+
+template <typename SampleType, int numLanes, int numBands>
+void BiquadBank<SampleType, numLanes, numBands>::stepRamp() noexcept
+{
+	if (rampStepsRemaining == 0)
+		return;
+
+	const auto fraction = SampleType(1) / SampleType(rampStepsRemaining--);
+	auto* current = &coefficients[0][0][0];
+	const auto* target = &targets[0][0][0];
+
+	for (int i = 0; i < numValues; i++)
+		current[i] += (target[i] - current[i]) * fraction;
+}
+
+template <typename SampleType, int numLanes, int numBands>
+void BiquadBank<SampleType, numLanes, numBands>::setCoefficients(int lane, int band, const juce::IIRCoefficients& coeffs)
+{
+	// IIRCoefficients is already normalised by a0
+	const auto* c = coeffs.coefficients;
+	setCoefficients(lane, band, c[0], c[1], c[2], 1.0, c[3], c[4]);
+}
+
+template <typename SampleType, int numLanes, int numBands>
+void BiquadBank<SampleType, numLanes, numBands>::processSample(SampleType* lanes) noexcept
+{
+	alignas(32) SampleType x[numLanes];
+	std::copy(lanes, lanes + numLanes, x);
+
+	for (int band = 0; band < numBands; band++)
+	{
+		const auto& c = coefficients[band];
+		auto* s1 = state1[band];
+		auto* s2 = state2[band];
+
+		for (int lane = 0; lane < numLanes; lane++)
+		{
+			const auto in = x[lane];
+			const auto out = c[b0][lane] * in + s1[lane];
+			s1[lane] = c[b1][lane] * in - c[a1][lane] * out + s2[lane];
+			s2[lane] = c[b2][lane] * in - c[a2][lane] * out;
+			x[lane] = out;
+		}
+	}
+
+	std::copy(x, x + numLanes, lanes);
+}
+
+template <typename SampleType, int numLanes, int numBands>
+void BiquadBank<SampleType, numLanes, numBands>::processBlock(SampleType* const* lanes, int numSamples) noexcept
+{
+	// one band over the whole block keeps its five coefficients and two states in registers
+	for (int band = 0; band < numBands; band++)
+	{
+		for (int lane = 0; lane < numLanes; lane++)
+		{
+			const auto cb0 = coefficients[band][b0][lane];
+			const auto cb1 = coefficients[band][b1][lane];
+			const auto cb2 = coefficients[band][b2][lane];
+			const auto ca1 = coefficients[band][a1][lane];
+			const auto ca2 = coefficients[band][a2][lane];
+			auto s1 = state1[band][lane];
+			auto s2 = state2[band][lane];
+			auto* data = lanes[lane];
+
+			for (int i = 0; i < numSamples; i++)
+			{
+				const auto in = data[i];
+				const auto out = cb0 * in + s1;
+				s1 = cb1 * in - ca1 * out + s2;
+				s2 = cb2 * in - ca2 * out;
+				data[i] = out;
+			}
+
+			state1[band][lane] = s1;
+			state2[band][lane] = s2;
+		}
+	}
+}
@@ -5,55 +5,213 @@
 //  Created by kweiwen tseng on 2021/1/10.
 //  Copyright © 2021 Sikhaa Electronics. All rights reserved.
 //
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
 #include <memory>
+#include <type_traits>
+#include "FDNLanes.h"
 #ifndef CircularBuffer_h
 #define CircularBuffer_h
 
+// --- polyphase fractional delay coefficients, numTaps taps around the integer delay, tap 0 is the oldest sample.
+// --- tap k sits at delay index + numTaps / 2 - k, so the taps cover numTaps / 2 samples on either side of the
+// --- fractional position. resolution + 1 rows are stored so every phase has a neighbour to blend with.
+template <int numTaps>
+struct FractionalDelayTable
+{
+	static_assert(numTaps >= 2 && numTaps % 2 == 0, "the taps have to sit symmetrically around the fractional position");
+
+	static constexpr int resolution = 256;
+	static constexpr int centre = numTaps / 2;
+
+	double coefficients[resolution + 1][numTaps];
+
+	// --- order numTaps - 1, 2 taps is linear interpolation
+	static const FractionalDelayTable& lagrange()
+	{
+		static const FractionalDelayTable table(&lagrangeWeights);
+		return table;
+	}
+
+	// --- the Catmull-Rom cubic of doHermitInterpolation, 4 taps only
+	static const FractionalDelayTable& hermite()
+	{
+		static_assert(numTaps == 4, "the Hermite interpolator uses 4 taps");
+		static const FractionalDelayTable table(&hermiteWeights);
+		return table;
+	}
+
+	// --- blends the two nearest phases, a table error of about -100 dB at 256 phases
+	void getCoefficients(double fraction, double* destination) const
+	{
+		const double phase = fraction * resolution;
+		int row = (int)phase;
+		row = row < 0 ? 0 : (row >= resolution ? resolution - 1 : row);
+		const double blend = phase - row;
+		const double* lower = coefficients[row];
+		const double* upper = coefficients[row + 1];
+		for (int k = 0; k < numTaps; k++)
+		{
+			destination[k] = lower[k] + (upper[k] - lower[k]) * blend;
+		}
+	}
+
+private:
+	explicit FractionalDelayTable(void (*weights)(double, double*))
+	{
+		for (int row = 0; row <= resolution; row++)
+		{
+			weights((double)row / resolution, coefficients[row]);
+		}
+	}
+
+	static void lagrangeWeights(double fraction, double* destination)
+	{
+		for (int k = 0; k < numTaps; k++)
+		{
+			double weight = 1.0;
+			for (int j = 0; j < numTaps; j++)
+			{
+				if (j != k)
+				{
+					weight *= (fraction - (centre - j)) / (double)(j - k);
+				}
+			}
+			destination[k] = weight;
+		}
+	}
+
+	static void hermiteWeights(double t, double* destination)
+	{
+		// --- doHermitInterpolation written per tap, taps are x2, x1, x0, xm1
+		destination[0] = 0.5 * t * t * (t - 1.0);
+		destination[1] = t * (0.5 + t * (2.0 - 1.5 * t));
+		destination[2] = 1.0 + t * t * (1.5 * t - 2.5);
+		destination[3] = t * (-0.5 + t * (1.0 - 0.5 * t));
+	}
+};
+
 template <typename T>
 class CircularBuffer
 {
 
 public:
+	// --- contiguous piece of the buffer, a block access yields at most two of them
+	struct Span
+	{
+		T* data;
+		int size;
+	};
+
+	// --- storage alignment in bytes, one cache line
+	static constexpr std::size_t alignment = 64;
+
 	CircularBuffer()
 	{
 		mWriteIndex = 0;
 		mBufferLength = 0;
 		mWrapMask = 0;
+		mGuardLength = 0;
 	};
 
 	~CircularBuffer()
 	{
 	};
 
-	void createCircularBuffer(unsigned int input);
+	void createCircularBuffer(unsigned int input, unsigned int guardLength = 0);
+	// --- same on memory the caller owns, e.g. an arena: getStorageLength() samples, cache line aligned
+	void createCircularBuffer(unsigned int input, unsigned int guardLength, T* storage);
+	static unsigned int getStorageLength(unsigned int input, unsigned int guardLength = 0);
 	void flushBuffer();
 	void writeBuffer(T input);
 
 	T readBuffer(int delayInSamples);
 	T readBuffer(double delayInFractionalSamples, bool interpolate = true);
 
+	int getReadSpans(int delayInSamples, int numSamples, Span& first, Span& second);
+	int getWriteSpans(int numSamples, Span& first, Span& second);
+	void readBlock(int delayInSamples, T* destination, int numSamples);
+	void writeBlock(const T* source, int numSamples);
+
 	float doLinearInterpolation(float delayInFractionalSamples);
 	float doHermitInterpolation(float delayInFractionalSamples);
 	float doLagrangeInterpolation(float delayInFractionalSamples);
 
+	// --- block reads through a FractionalDelayTable, both need a guard of at least numTaps - 1 samples.
+	// --- sample i is read as readBuffer would read it after i more writes, so like readBlock the whole
+	// --- block has to come from already written samples: int(delay) - numTaps / 2 + 1 >= numSamples.
+	// --- one fractional delay for the whole block: a short FIR over contiguous memory
+	template <int numTaps>
+	void readInterpolatedBlock(double delayInFractionalSamples, T* destination, int numSamples, const FractionalDelayTable<numTaps>& table);
+	// --- one fractional delay per sample, e.g. a modulated line. Scalar: every output has its own coefficients
+	// --- and its own taps, so there is nothing contiguous to vectorise over. The FDN in the processor does not
+	// --- modulate its lines yet and reads them with readBlock at integer delays.
+	template <int numTaps>
+	void readInterpolatedBlock(const float* delaysInFractionalSamples, T* destination, int numSamples, const FractionalDelayTable<numTaps>& table);
+	// --- numReads taps at independent fractional delays from the current write position, scalar for the same reason
+	template <int numTaps>
+	void readInterpolatedTaps(const float* delaysInFractionalSamples, T* destination, int numReads, const FractionalDelayTable<numTaps>& table);
+
 	//private:
-	std::unique_ptr<T[]> mBuffer = nullptr;
+	std::unique_ptr<char[]> mStorage = nullptr;
+	T* mBuffer = nullptr;
 	unsigned int mBufferLength;
 	unsigned int mWriteIndex;
 	unsigned int mWrapMask;
+	// --- number of samples mirrored past the end so short reads never wrap
+	unsigned int mGuardLength;
+
+private:
+	void updateGuard(unsigned int start, unsigned int numSamples);
+	static unsigned int roundUpToPowerOfTwo(unsigned int input);
 };
 
 template <typename T>
-void CircularBuffer<T>::createCircularBuffer(unsigned int input)
+unsigned int CircularBuffer<T>::roundUpToPowerOfTwo(unsigned int input)
+{
+	// --- integer rounding, logf can land just above an exact power of two and double the buffer
+	unsigned int length = 1;
+	while (length < input)
+	{
+		length <<= 1;
+	}
+	return length;
+}
+
+template <typename T>
+unsigned int CircularBuffer<T>::getStorageLength(unsigned int input, unsigned int guardLength /*= 0*/)
+{
+	const unsigned int length = roundUpToPowerOfTwo(input);
+	return length + (guardLength < length ? guardLength : length);
+}
+
+template <typename T>
+void CircularBuffer<T>::createCircularBuffer(unsigned int input, unsigned int guardLength /*= 0*/)
+{
+	// --- cache line aligned storage, over-allocated so the first sample can be moved onto the boundary
+	const std::size_t bytes = getStorageLength(input, guardLength) * sizeof(T);
+	std::unique_ptr<char[]> storage(new char[bytes + alignment]);
+	auto address = reinterpret_cast<std::uintptr_t>(storage.get());
+	createCircularBuffer(input, guardLength, reinterpret_cast<T*>((address + alignment - 1) & ~(std::uintptr_t)(alignment - 1)));
+	mStorage = std::move(storage);
+}
+
+template <typename T>
+void CircularBuffer<T>::createCircularBuffer(unsigned int input, unsigned int guardLength, T* storage)
 {
+	assert(reinterpret_cast<std::uintptr_t>(storage) % alignment == 0);
+	// --- heap storage of an earlier create is not needed any more
+	mStorage.reset();
 	// --- reset the to top
 	mWriteIndex = 0;
 	// --- init buffer length as power of 2
-	mBufferLength = (unsigned int)(pow(2, ceil(logf(input) / logf(2))));
+	mBufferLength = roundUpToPowerOfTwo(input);
 	// --- warp mask as (mBufferLength - 1) for binary &= calculation
 	mWrapMask = mBufferLength - 1;
-	// --- direct initialization object into mBufferLength size
-	mBuffer.reset(new T[mBufferLength]);
+	// --- the guard region mirrors the head of the buffer, it can never exceed the buffer itself
+	mGuardLength = guardLength < mBufferLength ? guardLength : mBufferLength;
+	mBuffer = storage;
 	// --- clean the value inside mBuffer
 	flushBuffer();
 }
@@ -61,7 +219,7 @@ void CircularBuffer<T>::createCircularBuffer(unsigned int input)
 template <typename T>
 void CircularBuffer<T>::flushBuffer()
 {
-	for (int i = 0; i < mBufferLength; i++)
+	for (unsigned int i = 0; i < mBufferLength + mGuardLength; i++)
 	{
 		mBuffer[i] = 0;
 	}
@@ -70,10 +228,73 @@ void CircularBuffer<T>::flushBuffer()
 template <typename T>
 void CircularBuffer<T>::writeBuffer(T input)
 {
+	// --- keep the mirrored tail in sync with the head
+	if (mWriteIndex < mGuardLength)
+	{
+		mBuffer[mBufferLength + mWriteIndex] = input;
+	}
 	mBuffer[mWriteIndex++] = input;
 	mWriteIndex &= mWrapMask;
 }
 
+template <typename T>
+void CircularBuffer<T>::updateGuard(unsigned int start, unsigned int numSamples)
+{
+	// --- only the part of [start, start + numSamples) that lands in the head needs mirroring
+	if (start >= mGuardLength)
+	{
+		return;
+	}
+	const unsigned int end = start + numSamples < mGuardLength ? start + numSamples : mGuardLength;
+	std::copy(mBuffer + start, mBuffer + end, mBuffer + mBufferLength + start);
+}
+
+template <typename T>
+// --- split the numSamples oldest-first samples starting delayInSamples back into at most two contiguous pieces,
+// --- returns the number of spans used. numSamples must not exceed the delay, otherwise the block would read
+// --- samples that have not been written yet.
+int CircularBuffer<T>::getReadSpans(int delayInSamples, int numSamples, Span& first, Span& second)
+{
+	assert(numSamples <= delayInSamples && delayInSamples <= (int)mBufferLength);
+	const unsigned int readIndex = (mWriteIndex - delayInSamples) & mWrapMask;
+	const int firstSize = (int)(mBufferLength - readIndex) < numSamples ? (int)(mBufferLength - readIndex) : numSamples;
+	first = { mBuffer + readIndex, firstSize };
+	second = { mBuffer, numSamples - firstSize };
+	return second.size > 0 ? 2 : 1;
+}
+
+template <typename T>
+int CircularBuffer<T>::getWriteSpans(int numSamples, Span& first, Span& second)
+{
+	assert(numSamples <= (int)mBufferLength);
+	const int firstSize = (int)(mBufferLength - mWriteIndex) < numSamples ? (int)(mBufferLength - mWriteIndex) : numSamples;
+	first = { mBuffer + mWriteIndex, firstSize };
+	second = { mBuffer, numSamples - firstSize };
+	return second.size > 0 ? 2 : 1;
+}
+
+template <typename T>
+void CircularBuffer<T>::readBlock(int delayInSamples, T* destination, int numSamples)
+{
+	Span first, second;
+	getReadSpans(delayInSamples, numSamples, first, second);
+	std::copy(first.data, first.data + first.size, destination);
+	std::copy(second.data, second.data + second.size, destination + first.size);
+}
+
+template <typename T>
+void CircularBuffer<T>::writeBlock(const T* source, int numSamples)
+{
+	Span first, second;
+	getWriteSpans(numSamples, first, second);
+	std::copy(source, source + first.size, first.data);
+	std::copy(source + first.size, source + numSamples, second.data);
+	// --- the head is touched either by the first span (write index near 0) or by the wrapped second span
+	updateGuard(mWriteIndex, first.size);
+	updateGuard(0, second.size);
+	mWriteIndex = (mWriteIndex + numSamples) & mWrapMask;
+}
+
 template<typename T>
 T CircularBuffer<T>::readBuffer(int delayInSamples)
 {
@@ -115,10 +336,23 @@ template<typename T>
 float CircularBuffer<T>::doHermitInterpolation(float delayInFractionalSamples)
 {
 	int index = (int)delayInFractionalSamples;
-	float xm1 = readBuffer(index - 1);;
-	float x0 = readBuffer(index);
-	float x1 = readBuffer(index + 1);
-	float x2 = readBuffer(index + 2);
+	float xm1, x0, x1, x2;
+	if (mGuardLength >= 3)
+	{
+		// --- the four taps are adjacent in memory, oldest first, and the guard keeps them contiguous
+		const T* taps = mBuffer + ((mWriteIndex - index - 2) & mWrapMask);
+		x2 = taps[0];
+		x1 = taps[1];
+		x0 = taps[2];
+		xm1 = taps[3];
+	}
+	else
+	{
+		xm1 = readBuffer(index - 1);
+		x0 = readBuffer(index);
+		x1 = readBuffer(index + 1);
+		x2 = readBuffer(index + 2);
+	}
 
 	float frac_pos = delayInFractionalSamples - (int)delayInFractionalSamples;
 
@@ -133,27 +367,125 @@ float CircularBuffer<T>::doHermitInterpolation(float delayInFractionalSamples)
 template<typename T>
 float CircularBuffer<T>::doLagrangeInterpolation(float delayInFractionalSamples)
 {
-	int n = 4;
+	// --- third order, the weights come from the table instead of twelve divisions per sample
+	const auto& table = FractionalDelayTable<4>::lagrange();
 	int index = (int)delayInFractionalSamples;
-	float x[4] = { float(index - 1), float(index), float(index + 1), float(index + 2) };
-	float y[4] = { readBuffer(index - 1), readBuffer(index), readBuffer(index + 1), readBuffer(index + 2) };
+	double c[4];
+	table.getCoefficients(delayInFractionalSamples - index, c);
 
-	float interpolation = 0;
-	for (int i = 0; i < n; i++)
+	if (mGuardLength >= 3)
 	{
-		float term = y[i];
-		for (int j = 0; j < n; j++)
+		const T* taps = mBuffer + ((mWriteIndex - index - 2) & mWrapMask);
+		return (float)(c[0] * taps[0] + c[1] * taps[1] + c[2] * taps[2] + c[3] * taps[3]);
+	}
+	return (float)(c[0] * readBuffer(index + 2) + c[1] * readBuffer(index + 1) + c[2] * readBuffer(index) + c[3] * readBuffer(index - 1));
+}
+
+template<typename T>
+template<int numTaps>
+void CircularBuffer<T>::readInterpolatedBlock(double delayInFractionalSamples, T* destination, int numSamples, const FractionalDelayTable<numTaps>& table)
+{
+	const int index = (int)delayInFractionalSamples;
+	assert(mGuardLength >= numTaps - 1 && index - numTaps / 2 + 1 >= numSamples && index + numTaps / 2 <= (int)mBufferLength);
+
+	double c[numTaps];
+	table.getCoefficients(delayInFractionalSamples - index, c);
+
+	// --- the guard lets the taps of every output run past the end, so only the outputs are split at the wrap
+	unsigned int start = (mWriteIndex - index - numTaps / 2) & mWrapMask;
+	int done = 0;
+	while (done < numSamples)
+	{
+		const int run = (int)(mBufferLength - start) < numSamples - done ? (int)(mBufferLength - start) : numSamples - done;
+		const T* source = mBuffer + start;
+		T* output = destination + done;
+
+		T ck[numTaps];
+		for (int k = 0; k < numTaps; k++)
 		{
-			if (j != i)
+			ck[k] = (T)c[k];
+		}
+
+		int i = 0;
+		if constexpr (std::is_same<T, float>::value)
+		{
+			// --- four outputs per vector, tap k of outputs i .. i + 3 is one unaligned load at source + i + k.
+			// --- Summed in the order of the scalar loop below, so the tail matches the vectorised part bit for bit
+			FDNLanes lanes[numTaps];
+			for (int k = 0; k < numTaps; k++)
+			{
+				lanes[k] = FDNLanes::broadcast(ck[k]);
+			}
+			for (; i + 4 <= run; i += 4)
 			{
-				term = term * (delayInFractionalSamples - x[j]) / (float)(x[i] - x[j]);
+				FDNLanes sum = lanes[0] * FDNLanes::loadUnaligned(source + i);
+				for (int k = 1; k < numTaps; k++)
+				{
+					sum = sum + lanes[k] * FDNLanes::loadUnaligned(source + i + k);
+				}
+				sum.storeUnaligned(output + i);
 			}
 		}
-		interpolation += term;
+		for (; i < run; i++)
+		{
+			T sum = 0;
+			for (int k = 0; k < numTaps; k++)
+			{
+				sum += ck[k] * source[i + k];
+			}
+			output[i] = sum;
+		}
+
+		done += run;
+		start = 0;
 	}
-	return interpolation;
 }
 
+template<typename T>
+template<int numTaps>
+void CircularBuffer<T>::readInterpolatedBlock(const float* delaysInFractionalSamples, T* destination, int numSamples, const FractionalDelayTable<numTaps>& table)
+{
+	assert(mGuardLength >= numTaps - 1);
+
+	double c[numTaps];
+	for (int i = 0; i < numSamples; i++)
+	{
+		const int index = (int)delaysInFractionalSamples[i];
+		assert(index - numTaps / 2 + 1 >= numSamples - i && index + numTaps / 2 <= (int)mBufferLength);
+		table.getCoefficients(delaysInFractionalSamples[i] - index, c);
+
+		const T* taps = mBuffer + ((mWriteIndex + i - index - numTaps / 2) & mWrapMask);
+		double sum = 0.0;
+		for (int k = 0; k < numTaps; k++)
+		{
+			sum += c[k] * taps[k];
+		}
+		destination[i] = (T)sum;
+	}
+}
+
+template<typename T>
+template<int numTaps>
+void CircularBuffer<T>::readInterpolatedTaps(const float* delaysInFractionalSamples, T* destination, int numReads, const FractionalDelayTable<numTaps>& table)
+{
+	assert(mGuardLength >= numTaps - 1);
+
+	double c[numTaps];
+	for (int r = 0; r < numReads; r++)
+	{
+		const int index = (int)delaysInFractionalSamples[r];
+		assert(index - numTaps / 2 + 1 >= 1 && index + numTaps / 2 <= (int)mBufferLength);
+		table.getCoefficients(delaysInFractionalSamples[r] - index, c);
+
+		const T* taps = mBuffer + ((mWriteIndex - index - numTaps / 2) & mWrapMask);
+		double sum = 0.0;
+		for (int k = 0; k < numTaps; k++)
+		{
+			sum += c[k] * taps[k];
+		}
+		destination[r] = (T)sum;
+	}
+}
 
 #endif /* CircularBuffer_h */
 
@@ -0,0 +1,86 @@
+/*
+  ==============================================================================
+
+    CoefficientTensor.h
+
+    Flat, fixed shape [rows][bands][6] block of { b0, b1, b2, a0, a1, a2 }
+    sections, the C++ side of the ndarray RIR2FDN returns. Rows 0 .. numLines-1
+    are the absorption cascades of the delay lines, the last row is the
+    transition (level) EQ. One contiguous array, so it can be filled with a
+    single copy from a numpy buffer and passed around by value.
+
+    The network dimensions live here as well, so the decode job, the design
+    worker and the render tool agree on the tensor shape without pulling in
+    the processor.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <istream>
+#include <ostream>
+
+template <int numLines, int numBands>
+struct CoefficientTensor
+{
+	static constexpr int numRows = numLines + 1;
+	static constexpr int bands = numBands;
+	static constexpr int sectionSize = 6;
+	static constexpr int size = numRows * numBands * sectionSize;
+
+	double data[size] = {};
+
+	double* section(int row, int band) noexcept                     { return data + (row * numBands + band) * sectionSize; }
+	const double* section(int row, int band) const noexcept         { return data + (row * numBands + band) * sectionSize; }
+
+	const double* absorption(int line, int band) const noexcept     { return section(line, band); }
+	const double* transition(int band) const noexcept               { return section(numLines, band); }
+
+	// plain text, one section of six numbers per line in row major order, the layout of
+	// np.savetxt(path, output_data.reshape(-1, 6)) on the RIR2FDN output
+	bool loadFromText(std::istream& stream)
+	{
+		for (auto& value : data)
+			if (!(stream >> value))
+				return false;
+		return isValid();
+	}
+
+	void saveAsText(std::ostream& stream) const
+	{
+		stream.precision(17);
+		for (int i = 0; i < size; i++)
+			stream << data[i] << ((i + 1) % sectionSize == 0 ? '\n' : ' ');
+	}
+
+	// a default constructed tensor has a0 == 0 everywhere and must not reach a filter
+	bool isValid() const noexcept
+	{
+		for (int row = 0; row < numRows; row++)
+			for (int band = 0; band < numBands; band++)
+				if (section(row, band)[3] == 0.0)
+					return false;
+		return true;
+	}
+};
+
+// number of feedback delay lines, a power of two from 4 to 64. Every output channel needs a line of its own,
+// so the default of 4 takes layouts up to quad; the Multichannel configuration builds with delaySize=16 for
+// layouts up to 7.1.4 at about four times the cost per sample
+#ifndef delaySize
+ #define delaySize 4
+#endif
+#define bandSize 11
+
+namespace ChannelLayout
+{
+	// widest bus layout, e.g. 7.1.4 with delaySize=16
+	constexpr int maxChannels = 16;
+}
+
+/** Every filter section the processor runs, published as one unit so the
+	audio thread never sees a half updated cascade.
+*/
+using FilterCoefficientSet = CoefficientTensor<delaySize, bandSize>;
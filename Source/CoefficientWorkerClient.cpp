@@ -0,0 +1,197 @@
+/*
+  ==============================================================================
+
+    CoefficientWorkerClient.cpp
+
+  ==============================================================================
+*/
+
+#include "CoefficientWorkerClient.h"
+
+CoefficientWorkerClient::CoefficientWorkerClient(const juce::File& workerExecutable, bool useStandIn)
+    : executable(workerExecutable),
+      standIn(useStandIn)
+{
+}
+
+CoefficientWorkerClient::~CoefficientWorkerClient()
+{
+    killWorkerProcess();
+
+    const juce::ScopedLock sl(pendingLock);
+    for (auto& job : pending)
+        job.second.status->state = RIRDecodeJob::State::cancelled;
+    pending.clear();
+}
+
+juce::File CoefficientWorkerClient::getDefaultExecutable()
+{
+    auto binary = juce::File::getSpecialLocation(juce::File::currentExecutableFile);
+   #if JUCE_WINDOWS
+    return binary.getSiblingFile("NN_Worker.exe");
+   #else
+    return binary.getSiblingFile("NN_Worker");
+   #endif
+}
+
+bool CoefficientWorkerClient::isRunning() const
+{
+    return running;
+}
+
+bool CoefficientWorkerClient::launch()
+{
+    using namespace CoefficientWorkerProtocol;
+    running = executable.existsAsFile()
+           && launchWorkerProcess(executable, standIn ? standInCommandLineUID : workerCommandLineUID, 10000);
+    return running;
+}
+
+void CoefficientWorkerClient::killWorkerForTesting()
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+    killWorkerProcess();
+}
+
+bool CoefficientWorkerClient::submit(const juce::File& rirFile, const juce::String& scriptDirectory, std::vector<float> delayLines,
+                                     std::shared_ptr<RIRDecodeJob::Status> status, RIRDecodeJob::Callback onFinished)
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+
+    if (!running && !launch())
+        return false;
+
+    CoefficientWorkerProtocol::Request request;
+    request.jobId = nextJobId++;
+    request.rirPath = rirFile.getFullPathName();
+    request.scriptDirectory = scriptDirectory;
+    request.delayLines = std::move(delayLines);
+
+    auto message = CoefficientWorkerProtocol::writeRequest(request);
+
+    {
+        const juce::ScopedLock sl(pendingLock);
+        pending[request.jobId] = { message, std::move(status), std::move(onFinished) };
+    }
+
+    // if the pipe is already broken, handleConnectionLost resends it after the relaunch
+    sendMessageToWorker(message);
+    return true;
+}
+
+void CoefficientWorkerClient::handleMessageFromWorker(const juce::MemoryBlock& message)
+{
+    using namespace CoefficientWorkerProtocol;
+
+    juce::MemoryInputStream stream(message, false);
+    juce::int64 jobId = 0;
+    const auto type = readHeader(stream, jobId);
+
+    if (type == MessageType::progress)
+    {
+        const auto state = stream.readInt();
+        const auto progress = stream.readFloat();
+
+        bool cancel = false;
+        {
+            const juce::ScopedLock sl(pendingLock);
+            auto job = pending.find(jobId);
+            if (job == pending.end())
+                return;
+
+            job->second.status->state = (RIRDecodeJob::State)state;
+            job->second.status->progress = progress;
+            cancel = job->second.status->cancelRequested.load();
+        }
+
+        // the editor only flips its flag, the worker hears about it on the next progress report
+        if (cancel)
+            sendMessageToWorker(writeCancel(jobId));
+    }
+    else if (type == MessageType::result)
+    {
+        ResultCode code;
+        FilterCoefficientSet result;
+
+        if (!readResult(stream, code, result) || (code == ResultCode::ok && !result.isValid()))
+            finishJob(jobId, RIRDecodeJob::State::failed, nullptr);
+        else if (code == ResultCode::ok)
+            finishJob(jobId, RIRDecodeJob::State::done, &result);
+        else
+            finishJob(jobId, code == ResultCode::cancelled ? RIRDecodeJob::State::cancelled : RIRDecodeJob::State::failed, nullptr);
+    }
+}
+
+void CoefficientWorkerClient::finishJob(juce::int64 jobId, RIRDecodeJob::State state, const FilterCoefficientSet* result)
+{
+    PendingJob job;
+
+    {
+        const juce::ScopedLock sl(pendingLock);
+        auto it = pending.find(jobId);
+        if (it == pending.end())
+            return;
+
+        job = std::move(it->second);
+        pending.erase(it);
+    }
+
+    // the worker is healthy again, earlier crashes no longer count against it
+    if (state == RIRDecodeJob::State::done)
+    {
+        numRestarts = 0;
+        job.status->progress = 1.0f;
+    }
+    job.status->state = state;
+
+    if (result != nullptr)
+    {
+        juce::MessageManager::callAsync([callback = std::move(job.onFinished), coefficients = *result]
+        {
+            // the worker read the file in its own process, the load reads it again
+            callback(coefficients, nullptr);
+        });
+    }
+}
+
+void CoefficientWorkerClient::handleConnectionLost()
+{
+    running = false;
+
+    // called on the connection's own thread, which cannot tear the connection down itself
+    juce::MessageManager::callAsync([weakThis = juce::WeakReference<CoefficientWorkerClient>(this)]
+    {
+        if (weakThis != nullptr)
+            weakThis->relaunchAndResend();
+    });
+}
+
+void CoefficientWorkerClient::relaunchAndResend()
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+
+    std::vector<juce::MemoryBlock> requests;
+    {
+        const juce::ScopedLock sl(pendingLock);
+        for (auto& job : pending)
+            requests.push_back(job.second.request);
+    }
+
+    // nothing in flight, the worker is started again by the next submit
+    if (requests.empty() || running)
+        return;
+
+    if (numRestarts < maxRestarts && launch())
+    {
+        ++numRestarts;
+        for (auto& request : requests)
+            sendMessageToWorker(request);
+        return;
+    }
+
+    // a worker that keeps dying is given up on, the jobs fail instead of looping forever
+    const juce::ScopedLock sl(pendingLock);
+    for (auto& job : pending)
+        job.second.status->state = RIRDecodeJob::State::failed;
+    pending.clear();
+}
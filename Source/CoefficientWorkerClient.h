@@ -0,0 +1,74 @@
+/*
+  ==============================================================================
+
+    CoefficientWorkerClient.h
+
+    Plugin side of the out-of-process coefficient designer. Each client owns
+    one NN_Worker process, so decodes started by different plugin instances
+    run in parallel processes and a Python crash never reaches the host. A
+    worker that dies is relaunched and its unfinished jobs are resent.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "CoefficientWorkerProtocol.h"
+#include "RIRDecodeJob.h"
+#include <map>
+
+class CoefficientWorkerClient : private juce::ChildProcessCoordinator
+{
+public:
+    /** useStandIn launches the worker as a stand-in that answers every job with fixed coefficients, for tests. */
+    explicit CoefficientWorkerClient(const juce::File& workerExecutable, bool useStandIn = false);
+    ~CoefficientWorkerClient() override;
+
+    /** Where the plugin looks for the worker: next to its own binary. */
+    static juce::File getDefaultExecutable();
+
+    /** Message thread only. Progress goes into status, the result arrives through
+        onFinished on the message thread, exactly like an in-process RIRDecodeJob.
+    */
+    bool submit(const juce::File& rirFile, const juce::String& scriptDirectory, std::vector<float> delayLines,
+                std::shared_ptr<RIRDecodeJob::Status> status, RIRDecodeJob::Callback onFinished);
+
+    bool isRunning() const;
+    int getNumRestarts() const                  { return numRestarts; }
+
+    /** Kills the worker process, for tests: the connection is lost as after a crash, so the worker
+        is relaunched and gets its unfinished jobs again. Message thread only.
+    */
+    void killWorkerForTesting();
+
+private:
+    struct PendingJob
+    {
+        juce::MemoryBlock request;
+        std::shared_ptr<RIRDecodeJob::Status> status;
+        RIRDecodeJob::Callback onFinished;
+    };
+
+    void handleMessageFromWorker(const juce::MemoryBlock& message) override;
+    void handleConnectionLost() override;
+
+    bool launch();
+    void relaunchAndResend();
+    void finishJob(juce::int64 jobId, RIRDecodeJob::State state, const FilterCoefficientSet* result);
+
+    // consecutive relaunches without a result in between, a worker that answers again starts from 0
+    static constexpr int maxRestarts = 5;
+
+    juce::File executable;
+    bool standIn;
+    std::atomic<bool> running{ false };
+    std::atomic<int> numRestarts{ 0 };
+    juce::int64 nextJobId = 1;
+
+    juce::CriticalSection pendingLock;
+    std::map<juce::int64, PendingJob> pending;
+
+    JUCE_DECLARE_WEAK_REFERENCEABLE(CoefficientWorkerClient)
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (CoefficientWorkerClient)
+};
@@ -0,0 +1,119 @@
+/*
+  ==============================================================================
+
+    CoefficientWorkerProtocol.h
+
+    Messages exchanged between the plugin and the NN_Worker design process
+    over the juce::ChildProcessCoordinator pipe. Every message starts with
+    its type and the job id it belongs to.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "CoefficientTensor.h"
+
+namespace CoefficientWorkerProtocol
+{
+    // passed on the worker command line, the stand-in answers with fixed coefficients and never starts Python
+    static const char* const workerCommandLineUID   = "nn-coefficient-worker";
+    static const char* const standInCommandLineUID  = "nn-coefficient-worker-stand-in";
+
+    enum class MessageType : juce::int32 { request = 1, cancel, progress, result };
+
+    enum class ResultCode : juce::int32 { ok = 0, failed, cancelled };
+
+    struct Request
+    {
+        juce::int64 jobId = 0;
+        juce::String rirPath;
+        juce::String scriptDirectory;
+        std::vector<float> delayLines;
+    };
+
+    inline juce::MemoryBlock writeRequest(const Request& request)
+    {
+        juce::MemoryOutputStream stream;
+        stream.writeInt((int)MessageType::request);
+        stream.writeInt64(request.jobId);
+        stream.writeString(request.rirPath);
+        stream.writeString(request.scriptDirectory);
+        stream.writeInt((int)request.delayLines.size());
+        for (auto delay : request.delayLines)
+            stream.writeFloat(delay);
+        return stream.getMemoryBlock();
+    }
+
+    inline juce::MemoryBlock writeCancel(juce::int64 jobId)
+    {
+        juce::MemoryOutputStream stream;
+        stream.writeInt((int)MessageType::cancel);
+        stream.writeInt64(jobId);
+        return stream.getMemoryBlock();
+    }
+
+    // state is an RIRDecodeJob::State
+    inline juce::MemoryBlock writeProgress(juce::int64 jobId, int state, float progress)
+    {
+        juce::MemoryOutputStream stream;
+        stream.writeInt((int)MessageType::progress);
+        stream.writeInt64(jobId);
+        stream.writeInt(state);
+        stream.writeFloat(progress);
+        return stream.getMemoryBlock();
+    }
+
+    template <int numLines, int numBands>
+    juce::MemoryBlock writeResult(juce::int64 jobId, ResultCode code, const CoefficientTensor<numLines, numBands>& tensor)
+    {
+        using Tensor = CoefficientTensor<numLines, numBands>;
+
+        juce::MemoryOutputStream stream;
+        stream.writeInt((int)MessageType::result);
+        stream.writeInt64(jobId);
+        stream.writeInt((int)code);
+        // the shape travels with the data so a mismatched worker build is rejected instead of misread
+        stream.writeInt(Tensor::numRows);
+        stream.writeInt(Tensor::bands);
+        stream.writeInt(Tensor::sectionSize);
+        stream.write(tensor.data, sizeof(tensor.data));
+        return stream.getMemoryBlock();
+    }
+
+    inline MessageType readHeader(juce::MemoryInputStream& stream, juce::int64& jobId)
+    {
+        auto type = (MessageType)stream.readInt();
+        jobId = stream.readInt64();
+        return type;
+    }
+
+    inline Request readRequest(juce::MemoryInputStream& stream, juce::int64 jobId)
+    {
+        Request request;
+        request.jobId = jobId;
+        request.rirPath = stream.readString();
+        request.scriptDirectory = stream.readString();
+        request.delayLines.resize((size_t)juce::jmax(0, stream.readInt()));
+        for (auto& delay : request.delayLines)
+            delay = stream.readFloat();
+        return request;
+    }
+
+    template <int numLines, int numBands>
+    bool readResult(juce::MemoryInputStream& stream, ResultCode& code, CoefficientTensor<numLines, numBands>& tensor)
+    {
+        using Tensor = CoefficientTensor<numLines, numBands>;
+
+        code = (ResultCode)stream.readInt();
+        const auto rows = stream.readInt();
+        const auto bands = stream.readInt();
+        const auto sectionSize = stream.readInt();
+
+        if (rows != Tensor::numRows || bands != Tensor::bands || sectionSize != Tensor::sectionSize)
+            return false;
+
+        return stream.read(tensor.data, sizeof(tensor.data)) == (int)sizeof(tensor.data);
+    }
+}
@@ -0,0 +1,515 @@
+/*
+  ==============================================================================
+
+    DecayFitNet.cpp
+
+  ==============================================================================
+*/
+
+#include "DecayFitNet.h"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <limits>
+#include <numeric>
+
+namespace
+{
+    constexpr double pi = 3.141592653589793238462643383279502884;
+    constexpr int butterworthOrder = 5;
+    // the toolbox drops the end of every band, where the filters ring into the truncation
+    constexpr double analysedFraction = 0.95;
+
+    const char weightsMagic[] = { 'D', 'F', 'N', 'W' };
+    constexpr int weightsVersion = 1;
+
+    int getNumGroups(int outputs)
+    {
+        return (outputs + 3) / 4;
+    }
+
+    // values[output * stride + offset] of four consecutive outputs in one vector, zero past the last output
+    FDNLanes gatherOutputs(const std::vector<float>& values, int firstOutput, int outputs, int stride, int offset)
+    {
+        alignas(16) float lanes[4] = {};
+        for (int lane = 0; lane < 4 && firstOutput + lane < outputs; lane++)
+            lanes[lane] = values[(size_t)((firstOutput + lane) * stride + offset)];
+        return FDNLanes::load(lanes);
+    }
+
+    bool readFloats(juce::InputStream& stream, std::vector<float>& values, int count)
+    {
+        if (count <= 0 || stream.getNumBytesRemaining() < (juce::int64)count * (juce::int64)sizeof(float))
+            return false;
+
+        values.resize((size_t)count);
+        for (auto& value : values)
+            value = stream.readFloat();
+        return true;
+    }
+}
+
+//==============================================================================
+DecayFitNet::DecayFitNet()
+{
+}
+
+DecayFitNet::~DecayFitNet()
+{
+}
+
+bool DecayFitNet::loadWeights(const juce::File& file)
+{
+    trunk.clear();
+    for (auto& head : heads)
+        head.clear();
+
+    juce::FileInputStream stream(file);
+    if (!stream.openedOk())
+        return false;
+
+    char magic[4] = {};
+    if (stream.read(magic, 4) != 4 || !std::equal(std::begin(magic), std::end(magic), std::begin(weightsMagic))
+        || stream.readInt() != weightsVersion)
+        return false;
+
+    inputLength = stream.readInt();
+    numSlopes = stream.readInt();
+    edcDbNormFactor = stream.readFloat();
+    referenceSeconds = stream.readFloat();
+
+    const auto numBands = stream.readInt();
+    if (inputLength <= 0 || numSlopes <= 0 || numBands <= 0 || numBands > 64 || edcDbNormFactor == 0.0f || referenceSeconds <= 0.0f)
+        return false;
+
+    filterFrequencies.resize((size_t)numBands);
+    for (auto& frequency : filterFrequencies)
+        frequency = stream.readFloat();
+
+    // the trunk, then the heads in the order of Head, the slope count head may be missing
+    const auto numStacks = stream.readInt();
+    if (numStacks < 1 + slopeCount || numStacks > 1 + numHeads)
+        return false;
+
+    Stack stacks[1 + numHeads];
+    for (int stack = 0; stack < numStacks; stack++)
+    {
+        if (!readStack(stream, stacks[stack]))
+            return false;
+    }
+
+    trunk = std::move(stacks[0]);
+    for (int head = 0; head < numHeads; head++)
+        heads[(size_t)head] = std::move(stacks[1 + head]);
+
+    if (!hasConsistentShapes())
+    {
+        trunk.clear();
+        for (auto& head : heads)
+            head.clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool DecayFitNet::hasConsistentShapes() const
+{
+    // one input through every stack, so layers that do not fit together are rejected here instead of being read
+    // out of bounds by estimate(), which takes numSlopes values from the decay time and amplitude heads
+    std::vector<float> features((size_t)inputLength, 0.0f);
+    int channels = 1, length = inputLength;
+    if (!run(trunk, features, channels, length))
+        return false;
+
+    for (int head = 0; head < numHeads; head++)
+    {
+        // only the slope count head is optional, readStack never returns an empty stack
+        if (heads[(size_t)head].empty())
+        {
+            if (head == slopeCount)
+                continue;
+            return false;
+        }
+
+        auto output = features;
+        int headChannels = channels, headLength = length;
+        if (!run(heads[(size_t)head], output, headChannels, headLength))
+            return false;
+
+        const auto size = (int)output.size();
+        const auto fits = head == noise ? size >= 1
+                        : head == slopeCount ? size >= 1 && size <= numSlopes
+                        : size == numSlopes;
+        if (!fits)
+            return false;
+    }
+
+    return true;
+}
+
+bool DecayFitNet::readStack(juce::InputStream& stream, Stack& stack)
+{
+    const auto numLayers = stream.readInt();
+    if (numLayers <= 0 || numLayers > 256)
+        return false;
+
+    std::vector<float> weights, bias;
+
+    for (int index = 0; index < numLayers; index++)
+    {
+        Layer layer;
+        layer.type = (LayerType)stream.readInt();
+
+        switch (layer.type)
+        {
+            case LayerType::conv:
+            case LayerType::linear:
+            {
+                layer.inputs = stream.readInt();
+                layer.outputs = stream.readInt();
+                if (layer.type == LayerType::conv)
+                {
+                    layer.kernel = stream.readInt();
+                    layer.padding = stream.readInt();
+                }
+
+                if (layer.inputs <= 0 || layer.outputs <= 0 || layer.kernel <= 0 || layer.padding < 0
+                    || !readFloats(stream, weights, layer.outputs * layer.inputs * layer.kernel)
+                    || !readFloats(stream, bias, layer.outputs))
+                    return false;
+
+                // torch keeps [output][input][kernel], the lanes run over outputs
+                const auto numGroups = getNumGroups(layer.outputs);
+                const auto stride = layer.inputs * layer.kernel;
+                layer.weights.resize((size_t)(stride * numGroups));
+                layer.bias.resize((size_t)numGroups);
+
+                for (int group = 0; group < numGroups; group++)
+                {
+                    layer.bias[(size_t)group] = gatherOutputs(bias, 4 * group, layer.outputs, 1, 0);
+                    for (int tap = 0; tap < stride; tap++)
+                        layer.weights[(size_t)(tap * numGroups + group)] = gatherOutputs(weights, 4 * group, layer.outputs, stride, tap);
+                }
+                break;
+            }
+
+            case LayerType::leakyRelu:
+            case LayerType::squarePlus:
+                layer.parameter = stream.readFloat();
+                break;
+
+            case LayerType::maxPool:
+                layer.parameter = (float)stream.readInt();
+                if (layer.parameter < 1.0f)
+                    return false;
+                break;
+
+            default:
+                return false;
+        }
+
+        stack.push_back(std::move(layer));
+    }
+
+    return true;
+}
+
+//==============================================================================
+std::vector<DecayFitNet::Section> DecayFitNet::designOctaveBand(double centre, double sampleRate)
+{
+    // scipy.signal.butter(5, [fc / sqrt(2), fc * sqrt(2)] / nyquist, 'bandpass', output='zpk'): analog prototype,
+    // lowpass to bandpass and the bilinear transform, all at the normalised rate of 2 that scipy uses
+    const auto nyquist = sampleRate / 2.0;
+    const double edges[] = { centre / std::sqrt(2.0) / nyquist, juce::jmin(centre * std::sqrt(2.0) / nyquist, 0.999) };
+    const double warped[] = { 4.0 * std::tan(pi * edges[0] / 2.0), 4.0 * std::tan(pi * edges[1] / 2.0) };
+    const auto bandwidth = warped[1] - warped[0];
+    const auto centreSquared = warped[0] * warped[1];
+
+    std::vector<std::complex<double>> poles;
+    for (int m = -butterworthOrder + 1; m < butterworthOrder; m += 2)
+    {
+        const auto lowpass = -std::exp(std::complex<double>(0.0, pi * m / (2.0 * butterworthOrder))) * (bandwidth / 2.0);
+        const auto offset = std::sqrt(lowpass * lowpass - centreSquared);
+        poles.push_back(lowpass + offset);
+        poles.push_back(lowpass - offset);
+    }
+
+    // butterworthOrder zeros at the origin of the bandpass prototype, bilinear: (4 + s) / (4 - s)
+    std::complex<double> gain = std::pow(bandwidth, (double)butterworthOrder) * std::pow(4.0, (double)butterworthOrder);
+    for (auto& pole : poles)
+    {
+        gain /= 4.0 - pole;
+        pole = (4.0 + pole) / (4.0 - pole);
+    }
+
+    // the zeros end up at +1 and -1, one of each per section, the poles in conjugate pairs
+    std::vector<std::complex<double>> upper;
+    for (const auto& pole : poles)
+        if (pole.imag() > 0.0)
+            upper.push_back(pole);
+    std::sort(upper.begin(), upper.end(), [](auto a, auto b) { return std::abs(a) < std::abs(b); });
+    jassert(upper.size() == (size_t)butterworthOrder);
+
+    std::vector<Section> sections;
+    for (const auto& pole : upper)
+        sections.push_back({ 1.0, 0.0, -1.0, 1.0, -2.0 * pole.real(), std::norm(pole) });
+
+    for (int k = 0; k < 3; k++)
+        sections.front()[(size_t)k] *= gain.real();
+
+    return sections;
+}
+
+void DecayFitNet::filter(const std::vector<Section>& sections, const float* input, double* output, int numSamples)
+{
+    for (int i = 0; i < numSamples; i++)
+        output[i] = input[i];
+
+    // transposed direct form II, like sosfilt
+    for (const auto& s : sections)
+    {
+        double z1 = 0.0, z2 = 0.0;
+        for (int i = 0; i < numSamples; i++)
+        {
+            const auto x = output[i];
+            const auto y = s[0] * x + z1;
+            z1 = s[1] * x - s[4] * y + z2;
+            z2 = s[2] * x - s[5] * y;
+            output[i] = y;
+        }
+    }
+}
+
+//==============================================================================
+std::vector<float> DecayFitNet::prepareInput(const double* edc, int edcLength) const
+{
+    std::vector<float> input((size_t)inputLength);
+    const auto scale = (double)edcLength / inputLength;
+
+    for (int i = 0; i < inputLength; i++)
+    {
+        // torch.nn.functional.interpolate(mode='linear', align_corners=False)
+        const auto position = juce::jmax(0.0, (i + 0.5) * scale - 0.5);
+        const auto index = juce::jmin((int)position, edcLength - 1);
+        const auto next = juce::jmin(index + 1, edcLength - 1);
+        const auto fraction = position - index;
+        const auto value = edc[index] + fraction * (edc[next] - edc[index]);
+
+        // in dB, mapped to the range the network was trained on
+        const auto level = 10.0 * std::log10(juce::jmax(value, (double)std::numeric_limits<float>::min()));
+        input[(size_t)i] = (float)(2.0 * level / edcDbNormFactor + 1.0);
+    }
+
+    return input;
+}
+
+bool DecayFitNet::run(const Stack& stack, std::vector<float>& x, int& channels, int& length)
+{
+    std::vector<float> y;
+    std::vector<FDNLanes> accumulators;
+
+    for (const auto& layer : stack)
+    {
+        switch (layer.type)
+        {
+            case LayerType::conv:
+            {
+                const auto numGroups = getNumGroups(layer.outputs);
+                const auto paddedLength = length + 2 * layer.padding;
+                const auto outputLength = paddedLength - layer.kernel + 1;
+                if (channels != layer.inputs || (int)x.size() != channels * length || outputLength < 1)
+                    return false;
+
+                std::vector<float> padded((size_t)(channels * paddedLength), 0.0f);
+                for (int channel = 0; channel < channels; channel++)
+                    std::copy_n(x.data() + channel * length, length, padded.data() + channel * paddedLength + layer.padding);
+
+                y.assign((size_t)(layer.outputs * outputLength), 0.0f);
+                accumulators.resize((size_t)numGroups);
+
+                for (int t = 0; t < outputLength; t++)
+                {
+                    std::copy(layer.bias.begin(), layer.bias.end(), accumulators.begin());
+
+                    auto* weight = layer.weights.data();
+                    for (int channel = 0; channel < channels; channel++)
+                    {
+                        const auto* window = padded.data() + channel * paddedLength + t;
+                        for (int k = 0; k < layer.kernel; k++)
+                        {
+                            const auto input = FDNLanes::broadcast(window[k]);
+                            for (int group = 0; group < numGroups; group++)
+                                accumulators[(size_t)group] = accumulators[(size_t)group] + *weight++ * input;
+                        }
+                    }
+
+                    for (int group = 0; group < numGroups; group++)
+                    {
+                        alignas(16) float lanes[4];
+                        accumulators[(size_t)group].store(lanes);
+                        for (int lane = 0; lane < 4 && 4 * group + lane < layer.outputs; lane++)
+                            y[(size_t)((4 * group + lane) * outputLength + t)] = lanes[lane];
+                    }
+                }
+
+                channels = layer.outputs;
+                length = outputLength;
+                x.swap(y);
+                break;
+            }
+
+            case LayerType::linear:
+            {
+                // a convolution output is flattened channel by channel, like view(batch, -1)
+                if ((int)x.size() != layer.inputs)
+                    return false;
+
+                const auto numGroups = getNumGroups(layer.outputs);
+                accumulators.assign(layer.bias.begin(), layer.bias.end());
+
+                auto* weight = layer.weights.data();
+                for (int i = 0; i < layer.inputs; i++)
+                {
+                    const auto input = FDNLanes::broadcast(x[(size_t)i]);
+                    for (int group = 0; group < numGroups; group++)
+                        accumulators[(size_t)group] = accumulators[(size_t)group] + *weight++ * input;
+                }
+
+                y.resize((size_t)(4 * numGroups));
+                for (int group = 0; group < numGroups; group++)
+                    accumulators[(size_t)group].store(y.data() + 4 * group);
+                y.resize((size_t)layer.outputs);
+
+                channels = layer.outputs;
+                length = 1;
+                x.swap(y);
+                break;
+            }
+
+            case LayerType::leakyRelu:
+                for (auto& value : x)
+                    value = value > 0.0f ? value : layer.parameter * value;
+                break;
+
+            case LayerType::maxPool:
+            {
+                const auto size = (int)layer.parameter;
+                const auto outputLength = length / size;
+                if ((int)x.size() != channels * length || outputLength < 1)
+                    return false;
+
+                y.resize((size_t)(channels * outputLength));
+
+                for (int channel = 0; channel < channels; channel++)
+                {
+                    for (int t = 0; t < outputLength; t++)
+                    {
+                        const auto* window = x.data() + channel * length + t * size;
+                        y[(size_t)(channel * outputLength + t)] = *std::max_element(window, window + size);
+                    }
+                }
+
+                length = outputLength;
+                x.swap(y);
+                break;
+            }
+
+            case LayerType::squarePlus:
+                for (auto& value : x)
+                    value = value * value + layer.parameter;
+                break;
+        }
+    }
+
+    return true;
+}
+
+//==============================================================================
+DecayFitNet::Estimate DecayFitNet::estimate(const float* rir, int numSamples, double sampleRate) const
+{
+    jassert(isLoaded());
+
+    Estimate result;
+    result.numBands = (int)filterFrequencies.size();
+    result.numSlopes = numSlopes;
+    result.T.assign((size_t)(result.numBands * numSlopes), 0.0);
+    result.A.assign((size_t)(result.numBands * numSlopes), 0.0);
+    result.N.assign((size_t)result.numBands, 0.0);
+    result.normalisation.assign((size_t)result.numBands, 0.0);
+
+    const auto edcLength = juce::roundToInt(analysedFraction * numSamples);
+    if (edcLength < 2 || sampleRate <= 0.0)
+        return result;
+
+    std::vector<double> band((size_t)numSamples);
+    std::vector<double> edc((size_t)edcLength);
+
+    for (int b = 0; b < result.numBands; b++)
+    {
+        filter(designOctaveBand(filterFrequencies[(size_t)b], sampleRate), rir, band.data(), numSamples);
+
+        // Schroeder backward integration of the energy, normalised to start at 1
+        double energy = 0.0;
+        for (int i = edcLength; --i >= 0;)
+        {
+            energy += band[(size_t)i] * band[(size_t)i];
+            edc[(size_t)i] = energy;
+        }
+
+        result.normalisation[(size_t)b] = energy;
+        if (energy <= 0.0)
+            continue;
+
+        for (auto& value : edc)
+            value /= energy;
+
+        // loadWeights() ran the same shapes already, a failure here leaves the band at 0
+        auto features = prepareInput(edc.data(), edcLength);
+        int channels = 1, length = inputLength;
+        if (!run(trunk, features, channels, length))
+            continue;
+
+        std::array<std::vector<float>, numHeads> outputs;
+        auto headsRan = true;
+        for (int head = 0; head < numHeads && headsRan; head++)
+        {
+            if (heads[(size_t)head].empty())
+                continue;
+
+            outputs[(size_t)head] = features;
+            int headChannels = channels, headLength = length;
+            headsRan = run(heads[(size_t)head], outputs[(size_t)head], headChannels, headLength);
+        }
+
+        if (!headsRan)
+            continue;
+
+        // the network sees every curve squeezed into inputLength samples: decay times are relative to referenceSeconds
+        // and the noise level is per input sample
+        const auto edcSeconds = edcLength / sampleRate;
+        const auto samplesPerInput = (double)edcLength / inputLength;
+        result.N[(size_t)b] = std::pow(10.0, (double)outputs[noise][0]) / samplesPerInput;
+
+        auto activeSlopes = numSlopes;
+        if (!outputs[slopeCount].empty())
+        {
+            const auto& logits = outputs[slopeCount];
+            activeSlopes = 1 + (int)(std::max_element(logits.begin(), logits.end()) - logits.begin());
+        }
+
+        std::vector<std::pair<double, double>> slopes;
+        for (int slope = 0; slope < activeSlopes; slope++)
+            slopes.emplace_back(outputs[decayTime][(size_t)slope] * edcSeconds / referenceSeconds, (double)outputs[amplitude][(size_t)slope]);
+        std::sort(slopes.begin(), slopes.end());
+
+        for (size_t slope = 0; slope < slopes.size(); slope++)
+        {
+            result.T[(size_t)b * (size_t)numSlopes + slope] = slopes[slope].first;
+            result.A[(size_t)b * (size_t)numSlopes + slope] = slopes[slope].second;
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,101 @@
+/*
+  ==============================================================================
+
+    DecayFitNet.h
+
+    Native inference of DecayFitNet (Götz et al.), the decay analysis of
+    RIR2FDN without Python: octave filterbank, energy decay curves, the
+    network and the rescaling of its outputs, after the DecayFitNetToolbox
+    estimate_parameters path. The layers and the input transform come from
+    a weights file that export_decayfitnet_weights in external.py writes
+    once from the toolbox's model, so a retrained network only needs a new
+    file. demo_compare_decayFitNet checks both against each other.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "FDNLanes.h"
+#include <array>
+#include <vector>
+
+class DecayFitNet
+{
+public:
+    // { b0, b1, b2, a0, a1, a2 }, a0 == 1
+    using Section = std::array<double, 6>;
+
+    struct Estimate
+    {
+        int numBands = 0;
+        int numSlopes = 0;
+        // numBands x numSlopes, row major, sorted by decay time; slopes the network switched off are 0
+        std::vector<double> T;
+        std::vector<double> A;
+        // noise level per band
+        std::vector<double> N;
+        // energy each band's decay curve was divided by before it went into the network
+        std::vector<double> normalisation;
+
+        double getT(int band, int slope = 0) const          { return T[(size_t)(band * numSlopes + slope)]; }
+        double getA(int band, int slope = 0) const          { return A[(size_t)(band * numSlopes + slope)]; }
+    };
+
+    DecayFitNet();
+    ~DecayFitNet();
+
+    /** Reads a file written by export_decayfitnet_weights, false if it is not one or its layers do not fit together. */
+    bool loadWeights(const juce::File& file);
+    bool isLoaded() const noexcept                          { return !trunk.empty(); }
+
+    /** Centre frequencies of the octave bands the network was converted for, in Hz. */
+    const std::vector<double>& getFilterFrequencies() const { return filterFrequencies; }
+
+    /** Decay parameters of every band of a mono RIR, the whole response is analysed. */
+    Estimate estimate(const float* rir, int numSamples, double sampleRate) const;
+
+    /** Fifth order Butterworth octave band around centre, in sections like scipy's butter + zpk2sos. */
+    static std::vector<Section> designOctaveBand(double centre, double sampleRate);
+    static void filter(const std::vector<Section>& sections, const float* input, double* output, int numSamples);
+
+private:
+    enum class LayerType { conv = 1, linear = 2, leakyRelu = 3, maxPool = 4, squarePlus = 5 };
+
+    struct Layer
+    {
+        LayerType type;
+        int inputs = 0;
+        int outputs = 0;
+        int kernel = 1;
+        int padding = 0;
+        // slope of leakyRelu, size of maxPool, offset of squarePlus
+        float parameter = 0.0f;
+        // [input][kernel][outputs / 4], four outputs per vector so every weight load feeds four accumulators
+        std::vector<FDNLanes> weights;
+        std::vector<FDNLanes> bias;
+    };
+
+    using Stack = std::vector<Layer>;
+    enum Head { decayTime, amplitude, noise, slopeCount, numHeads };
+
+    static bool readStack(juce::InputStream& stream, Stack& stack);
+    // false when x does not have the shape a layer expects, x is left half processed then
+    static bool run(const Stack& stack, std::vector<float>& x, int& channels, int& length);
+    bool hasConsistentShapes() const;
+
+    std::vector<float> prepareInput(const double* edc, int edcLength) const;
+
+    std::vector<double> filterFrequencies;
+    int inputLength = 0;
+    int numSlopes = 0;
+    float edcDbNormFactor = 1.0f;
+    // decay times come out of the network relative to a decay curve of this many seconds
+    float referenceSeconds = 1.0f;
+
+    Stack trunk;
+    std::array<Stack, numHeads> heads;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DecayFitNet)
+};
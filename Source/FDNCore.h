@@ -0,0 +1,374 @@
+/*
+  ==============================================================================
+
+    FDNCore.h
+
+    Vectorised N-line feedback delay network. All delay lines live in one
+    interleaved buffer so every sample is a run of float4 writes, the
+    absorption cascades keep their state in vector lanes (one lane per line)
+    and the NxN Hadamard feedback matrix is computed as an in-place fast
+    Walsh-Hadamard transform without leaving the registers.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "FDNLanes.h"
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+
+//==============================================================================
+/** In-place fast Walsh-Hadamard transform in natural (Sylvester) order, unnormalised.
+	size must be a power of two, the cost is size * log2(size) additions.
+*/
+template <typename SampleType>
+void fastWalshHadamard(SampleType* data, int size) noexcept
+{
+	for (int half = 1; half < size; half *= 2)
+	{
+		for (int start = 0; start < size; start += 2 * half)
+		{
+			for (int i = start; i < start + half; i++)
+			{
+				const auto a = data[i];
+				const auto b = data[i + half];
+				data[i] = a + b;
+				data[i + half] = a - b;
+			}
+		}
+	}
+}
+
+//==============================================================================
+/** Float counterpart of the reference FDN loop in nnAudioProcessor::processBlock.
+
+	Produces the same two taps before the transition filters so that both
+	implementations can be compared sample by sample. Line 0 and 1 take the
+	left and right input, lines with an even number of set index bits feed the
+	left tap and the others the right one (A + D, B + C for four lines).
+*/
+template <int numLines, int numBands>
+class FDNCore
+{
+public:
+	static_assert(numLines >= 4 && numLines <= 64 && (numLines & (numLines - 1)) == 0, "the line count must be a power of two from 4 to 64");
+
+	static constexpr int numVectors = numLines / 4;
+
+	/** 1 / sqrt(numLines) keeps the feedback matrix orthonormal, 0.5 for four lines. */
+	static double getMatrixGain() noexcept                      { return 1.0 / std::sqrt((double)numLines); }
+
+	/** Keeps the level of each tap where the 4-line network had it, 1 for four lines. */
+	static double getTapGain() noexcept                         { return std::sqrt(4.0 / (double)numLines); }
+
+	/** Same level for the multichannel taps, which sum all lines instead of half of them. */
+	static double getDecorrelatedTapGain() noexcept             { return std::sqrt(2.0 / (double)numLines); }
+
+	static constexpr bool feedsLeftTap(int line) noexcept
+	{
+		return ((line ^ (line >> 1) ^ (line >> 2) ^ (line >> 3) ^ (line >> 4) ^ (line >> 5)) & 1) == 0;
+	}
+
+	FDNCore()
+	{
+		for (int band = 0; band < numBands; band++)
+			for (int c = 0; c < numCoefficients; c++)
+				for (int v = 0; v < numVectors; v++)
+					coefficients[band][c][v] = targets[band][c][v] = FDNLanes::broadcast(0.0f);
+
+		reset();
+	};
+
+	~FDNCore()
+	{
+	};
+
+	void prepare(const std::array<int, numLines>& delaysInSamples);
+	/** Same on memory the caller owns, e.g. an arena: getStorageSize() floats, 16 byte aligned. */
+	void prepare(const std::array<int, numLines>& delaysInSamples, float* memory);
+	static int getStorageSize(const std::array<int, numLines>& delaysInSamples) noexcept;
+	void reset();
+	void setCoefficients(int line, int band, const juce::IIRCoefficients& coeffs);
+
+	// same staging scheme as BiquadBank: stage, then ramp over numSteps calls of stepRamp()
+	void setTargetCoefficients(int line, int band, const juce::IIRCoefficients& coeffs);
+	void rampToTargets(int numSteps);
+	void stepRamp() noexcept;
+
+	template <typename InputType, typename SampleType>
+	void process(const InputType* inputL, const InputType* inputR, SampleType* tapL, SampleType* tapR, int numSamples);
+
+	/** Multichannel variant for up to numLines channels. Input c feeds line c, output c is row c of the
+		Hadamard transform of the filtered lines, so every output hears all lines with its own orthogonal
+		sign pattern and the outputs are mutually decorrelated. The transform is the one the feedback
+		matrix computes anyway, the taps cost one scaled store per channel.
+	*/
+	template <typename InputType, typename SampleType>
+	void process(const InputType* const* inputs, SampleType* const* taps, int numChannels, int numSamples);
+
+private:
+	enum { b0, b1, b2, a1, a2, numCoefficients };
+
+	/** One sample of the network: reads and filters every line into x, leaves the Hadamard transform of x in h
+		and writes it back scaled, plus the first numInjected input vectors.
+	*/
+	void step(const FDNLanes* injection, int numInjected, FDNLanes* x, FDNLanes* h) noexcept;
+
+	static void storeCoefficients(FDNLanes (&destination)[numBands][numCoefficients][numVectors], int line, int band, const juce::IIRCoefficients& coeffs);
+
+	alignas(16) FDNLanes coefficients[numBands][numCoefficients][numVectors];
+	alignas(16) FDNLanes targets[numBands][numCoefficients][numVectors];
+	int rampStepsRemaining = 0;
+	alignas(16) FDNLanes state1[numBands][numVectors];
+	alignas(16) FDNLanes state2[numBands][numVectors];
+
+	// interleaved delay memory, numLines floats per slot
+	std::unique_ptr<float[]> storage;
+	float* lines = nullptr;
+	unsigned int bufferLength = 0;
+	unsigned int wrapMask = 0;
+	unsigned int writeIndex = 0;
+	std::array<int, numLines> delays{};
+};
+
+template <int numLines, int numBands>
+int FDNCore<numLines, numBands>::getStorageSize(const std::array<int, numLines>& delaysInSamples) noexcept
+{
+	int longest = 1;
+	for (auto d : delaysInSamples)
+		longest = juce::jmax(longest, d + 1);
+
+	return juce::nextPowerOfTwo(longest) * numLines;
+}
+
+template <int numLines, int numBands>
+void FDNCore<numLines, numBands>::prepare(const std::array<int, numLines>& delaysInSamples)
+{
+	// over-allocate by 4 floats so the interleaved rows can start on a 16 byte boundary
+	std::unique_ptr<float[]> heap(new float[getStorageSize(delaysInSamples) + 4]);
+	auto address = reinterpret_cast<std::uintptr_t>(heap.get());
+	prepare(delaysInSamples, reinterpret_cast<float*>((address + 15) & ~std::uintptr_t(15)));
+	storage = std::move(heap);
+}
+
+template <int numLines, int numBands>
+void FDNCore<numLines, numBands>::prepare(const std::array<int, numLines>& delaysInSamples, float* memory)
+{
+	jassert(reinterpret_cast<std::uintptr_t>(memory) % 16 == 0);
+
+	delays = delaysInSamples;
+	bufferLength = (unsigned int) (getStorageSize(delaysInSamples) / numLines);
+	wrapMask = bufferLength - 1;
+
+	storage.reset();
+	lines = memory;
+
+	reset();
+}
+
+template <int numLines, int numBands>
+void FDNCore<numLines, numBands>::reset()
+{
+	for (int band = 0; band < numBands; band++)
+	{
+		for (int v = 0; v < numVectors; v++)
+		{
+			state1[band][v] = FDNLanes::broadcast(0.0f);
+			state2[band][v] = FDNLanes::broadcast(0.0f);
+		}
+	}
+
+	if (lines != nullptr)
+		std::fill(lines, lines + bufferLength * numLines, 0.0f);
+
+	writeIndex = 0;
+}
+
+template <int numLines, int numBands>
+void FDNCore<numLines, numBands>::storeCoefficients(FDNLanes (&destination)[numBands][numCoefficients][numVectors], int line, int band, const juce::IIRCoefficients& coeffs)
+{
+	jassert(juce::isPositiveAndBelow(line, numLines) && juce::isPositiveAndBelow(band, numBands));
+
+	// IIRCoefficients stores { b0, b1, b2, a1, a2 } already normalised by a0
+	alignas(16) float lane[4];
+	const auto vector = line / 4;
+	for (int c = 0; c < numCoefficients; c++)
+	{
+		destination[band][c][vector].store(lane);
+		lane[line % 4] = coeffs.coefficients[c];
+		destination[band][c][vector] = FDNLanes::load(lane);
+	}
+}
+
+template <int numLines, int numBands>
+void FDNCore<numLines, numBands>::setCoefficients(int line, int band, const juce::IIRCoefficients& coeffs)
+{
+	storeCoefficients(coefficients, line, band, coeffs);
+	storeCoefficients(targets, line, band, coeffs);
+}
+
+template <int numLines, int numBands>
+void FDNCore<numLines, numBands>::setTargetCoefficients(int line, int band, const juce::IIRCoefficients& coeffs)
+{
+	storeCoefficients(targets, line, band, coeffs);
+}
+
+template <int numLines, int numBands>
+void FDNCore<numLines, numBands>::rampToTargets(int numSteps)
+{
+	rampStepsRemaining = juce::jmax(0, numSteps);
+
+	if (rampStepsRemaining == 0)
+		for (int band = 0; band < numBands; band++)
+			for (int c = 0; c < numCoefficients; c++)
+				for (int v = 0; v < numVectors; v++)
+					coefficients[band][c][v] = targets[band][c][v];
+}
+
+template <int numLines, int numBands>
+void FDNCore<numLines, numBands>::stepRamp() noexcept
+{
+	if (rampStepsRemaining == 0)
+		return;
+
+	const auto fraction = FDNLanes::broadcast(1.0f / (float)rampStepsRemaining--);
+
+	for (int band = 0; band < numBands; band++)
+		for (int c = 0; c < numCoefficients; c++)
+			for (int v = 0; v < numVectors; v++)
+				coefficients[band][c][v] = coefficients[band][c][v] + (targets[band][c][v] - coefficients[band][c][v]) * fraction;
+}
+
+template <int numLines, int numBands>
+void FDNCore<numLines, numBands>::step(const FDNLanes* injection, int numInjected, FDNLanes* x, FDNLanes* h) noexcept
+{
+	const auto matrixGain = FDNLanes::broadcast((float)getMatrixGain());
+	alignas(16) const float oddSigns[4]  = { 1.0f, -1.0f, 1.0f, -1.0f };
+	alignas(16) const float upperSigns[4] = { 1.0f, 1.0f, -1.0f, -1.0f };
+	const auto signsStage1 = FDNLanes::load(oddSigns);
+	const auto signsStage2 = FDNLanes::load(upperSigns);
+
+	// gather one sample from every line
+	alignas(16) float lane[numLines];
+	for (int line = 0; line < numLines; line++)
+		lane[line] = lines[((writeIndex - delays[line]) & wrapMask) * numLines + line];
+
+	for (int v = 0; v < numVectors; v++)
+	{
+		x[v] = FDNLanes::load(lane + 4 * v);
+
+		// absorption cascade, transposed direct form II, one lane per line
+		for (int band = 0; band < numBands; band++)
+		{
+			const auto& c = coefficients[band];
+			auto y = c[b0][v] * x[v] + state1[band][v];
+			state1[band][v] = c[b1][v] * x[v] - c[a1][v] * y + state2[band][v];
+			state2[band][v] = c[b2][v] * x[v] - c[a2][v] * y;
+			x[v] = y;
+		}
+
+		// first two Walsh-Hadamard stages inside the vector:
+		// [A B C D] -> [A+B A-B C+D C-D] -> [A+B+C+D A-B+C-D A+B-C-D A-B-C+D]
+		auto t = x[v].swapPairs() + x[v] * signsStage1;
+		h[v] = t.swapHalves() + t * signsStage2;
+	}
+
+	// remaining stages pair whole vectors
+	for (int half = 1; half < numVectors; half *= 2)
+	{
+		for (int start = 0; start < numVectors; start += 2 * half)
+		{
+			for (int v = start; v < start + half; v++)
+			{
+				const auto a = h[v];
+				const auto b = h[v + half];
+				h[v] = a + b;
+				h[v + half] = a - b;
+			}
+		}
+	}
+
+	auto* slot = lines + writeIndex * numLines;
+	for (int v = 0; v < numVectors; v++)
+	{
+		if (v < numInjected)
+			(h[v] * matrixGain + injection[v]).store(slot + 4 * v);
+		else
+			(h[v] * matrixGain).store(slot + 4 * v);
+	}
+
+	writeIndex = (writeIndex + 1) & wrapMask;
+}
+
+template <int numLines, int numBands>
+template <typename InputType, typename SampleType>
+void FDNCore<numLines, numBands>::process(const InputType* inputL, const InputType* inputR, SampleType* tapL, SampleType* tapR, int numSamples)
+{
+	jassert(lines != nullptr);
+
+	const auto tapGain = (float)getTapGain();
+
+	FDNLanes x[numVectors];
+	FDNLanes h[numVectors];
+
+	for (int i = 0; i < numSamples; i++)
+	{
+		alignas(16) const float injection[4] = { (float) inputL[i], (float) inputR[i], 0.0f, 0.0f };
+		const auto injectionVector = FDNLanes::load(injection);
+		step(&injectionVector, 1, x, h);
+
+		// the tap parity of lane l in vector v is parity(v) ^ parity(l), sum both vector classes first
+		auto evenVectors = x[0];
+		auto oddVectors = FDNLanes::broadcast(0.0f);
+		for (int v = 1; v < numVectors; v++)
+		{
+			if (feedsLeftTap(v))
+				evenVectors = evenVectors + x[v];
+			else
+				oddVectors = oddVectors + x[v];
+		}
+
+		alignas(16) float even[4], odd[4];
+		evenVectors.store(even);
+		oddVectors.store(odd);
+		tapL[i] = (SampleType) ((even[0] + even[3] + odd[1] + odd[2]) * tapGain);
+		tapR[i] = (SampleType) ((even[1] + even[2] + odd[0] + odd[3]) * tapGain);
+	}
+}
+
+template <int numLines, int numBands>
+template <typename InputType, typename SampleType>
+void FDNCore<numLines, numBands>::process(const InputType* const* inputs, SampleType* const* taps, int numChannels, int numSamples)
+{
+	jassert(lines != nullptr);
+	jassert(numChannels >= 1 && numChannels <= numLines);
+
+	numChannels = juce::jlimit(1, numLines, numChannels);
+	const auto numInjected = (numChannels + 3) / 4;
+	const auto tapGain = (float)getDecorrelatedTapGain();
+
+	FDNLanes x[numVectors];
+	FDNLanes h[numVectors];
+	FDNLanes injectionVectors[numVectors];
+	alignas(16) float injection[numLines] = {};
+	alignas(16) float rows[numLines];
+
+	for (int i = 0; i < numSamples; i++)
+	{
+		for (int channel = 0; channel < numChannels; channel++)
+			injection[channel] = (float) inputs[channel][i];
+		for (int v = 0; v < numInjected; v++)
+			injectionVectors[v] = FDNLanes::load(injection + 4 * v);
+
+		step(injectionVectors, numInjected, x, h);
+
+		for (int v = 0; v < numVectors; v++)
+			h[v].store(rows + 4 * v);
+		for (int channel = 0; channel < numChannels; channel++)
+			taps[channel][i] = (SampleType) (rows[channel] * tapGain);
+	}
+}
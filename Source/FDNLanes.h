@@ -0,0 +1,76 @@
+/*
+  ==============================================================================
+
+    FDNLanes.h
+
+    Four float lanes on SSE2, NEON or plain arrays, the one vector type of
+    the project. The network core keeps one delay line per lane, the
+    fractional delay reads of CircularBuffer and the DecayFitNet layers
+    four outputs per lane. No JUCE, so the DSP headers can share it.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+ #include <emmintrin.h>
+ #define NN_FDN_SSE 1
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__) || defined (_M_ARM64)
+ #include <arm_neon.h>
+ #define NN_FDN_NEON 1
+#endif
+
+//==============================================================================
+/** Four float lanes, one per delay line. Larger networks use several of them. */
+struct alignas(16) FDNLanes
+{
+#if NN_FDN_SSE
+	__m128 v;
+
+	static FDNLanes load(const float* p) noexcept                       { return { _mm_load_ps(p) }; }
+	static FDNLanes loadUnaligned(const float* p) noexcept              { return { _mm_loadu_ps(p) }; }
+	static FDNLanes broadcast(float x) noexcept                         { return { _mm_set1_ps(x) }; }
+	void store(float* p) const noexcept                                 { _mm_store_ps(p, v); }
+	void storeUnaligned(float* p) const noexcept                        { _mm_storeu_ps(p, v); }
+
+	friend FDNLanes operator+ (FDNLanes a, FDNLanes b) noexcept         { return { _mm_add_ps(a.v, b.v) }; }
+	friend FDNLanes operator- (FDNLanes a, FDNLanes b) noexcept         { return { _mm_sub_ps(a.v, b.v) }; }
+	friend FDNLanes operator* (FDNLanes a, FDNLanes b) noexcept         { return { _mm_mul_ps(a.v, b.v) }; }
+
+	// [a b c d] -> [b a d c]
+	FDNLanes swapPairs() const noexcept                                 { return { _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)) }; }
+	// [a b c d] -> [c d a b]
+	FDNLanes swapHalves() const noexcept                                { return { _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)) }; }
+#elif NN_FDN_NEON
+	float32x4_t v;
+
+	static FDNLanes load(const float* p) noexcept                       { return { vld1q_f32(p) }; }
+	static FDNLanes loadUnaligned(const float* p) noexcept              { return { vld1q_f32(p) }; }
+	static FDNLanes broadcast(float x) noexcept                         { return { vdupq_n_f32(x) }; }
+	void store(float* p) const noexcept                                 { vst1q_f32(p, v); }
+	void storeUnaligned(float* p) const noexcept                        { vst1q_f32(p, v); }
+
+	friend FDNLanes operator+ (FDNLanes a, FDNLanes b) noexcept         { return { vaddq_f32(a.v, b.v) }; }
+	friend FDNLanes operator- (FDNLanes a, FDNLanes b) noexcept         { return { vsubq_f32(a.v, b.v) }; }
+	friend FDNLanes operator* (FDNLanes a, FDNLanes b) noexcept         { return { vmulq_f32(a.v, b.v) }; }
+
+	FDNLanes swapPairs() const noexcept                                 { return { vrev64q_f32(v) }; }
+	FDNLanes swapHalves() const noexcept                                { return { vextq_f32(v, v, 2) }; }
+#else
+	float v[4];
+
+	static FDNLanes load(const float* p) noexcept                       { return { { p[0], p[1], p[2], p[3] } }; }
+	static FDNLanes loadUnaligned(const float* p) noexcept              { return load(p); }
+	static FDNLanes broadcast(float x) noexcept                         { return { { x, x, x, x } }; }
+	void store(float* p) const noexcept                                 { for (int i = 0; i < 4; i++) p[i] = v[i]; }
+	void storeUnaligned(float* p) const noexcept                        { store(p); }
+
+	friend FDNLanes operator+ (FDNLanes a, FDNLanes b) noexcept         { return { { a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3] } }; }
+	friend FDNLanes operator- (FDNLanes a, FDNLanes b) noexcept         { return { { a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3] } }; }
+	friend FDNLanes operator* (FDNLanes a, FDNLanes b) noexcept         { return { { a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3] } }; }
+
+	FDNLanes swapPairs() const noexcept                                 { return { { v[1], v[0], v[3], v[2] } }; }
+	FDNLanes swapHalves() const noexcept                                { return { { v[2], v[3], v[0], v[1] } }; }
+#endif
+};
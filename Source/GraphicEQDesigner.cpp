@@ -0,0 +1,344 @@
+/*
+  ==============================================================================
+
+    GraphicEQDesigner.cpp
+
+  ==============================================================================
+*/
+
+#include "GraphicEQDesigner.h"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <limits>
+
+namespace
+{
+    constexpr double pi = 3.141592653589793238462643383279502884;
+    constexpr double prototypeGain = 10.0;     // dB
+    constexpr double R = 2.7;
+
+    double hertz2rad(double freq, double fs)
+    {
+        return 2.0 * pi * freq / fs;
+    }
+
+    // np.interp: linear interpolation, clamped to the end values outside xp
+    double interp(double x, const double* xp, const double* fp, int n)
+    {
+        if (x <= xp[0])
+            return fp[0];
+        if (x >= xp[n - 1])
+            return fp[n - 1];
+
+        auto j = int(std::upper_bound(xp, xp + n, x) - xp) - 1;
+        auto slope = (fp[j + 1] - fp[j]) / (xp[j + 1] - xp[j]);
+        return slope * (x - xp[j]) + fp[j];
+    }
+
+    double magnitudeIndB(const GraphicEQDesigner::Section& s, double omega)
+    {
+        const std::complex<double> z1 = std::polar(1.0, -omega);
+        const std::complex<double> z2 = z1 * z1;
+        const auto h = (s[0] + s[1] * z1 + s[2] * z2) / (s[3] + s[4] * z1 + s[5] * z2);
+        return 20.0 * std::log10(std::abs(h));
+    }
+
+    // solves M y = r in place for an n x n system, partial pivoting
+    void solveLinearSystem(std::vector<double>& M, std::vector<double>& r, int n)
+    {
+        for (int col = 0; col < n; col++)
+        {
+            int pivot = col;
+            for (int row = col + 1; row < n; row++)
+                if (std::abs(M[row * n + col]) > std::abs(M[pivot * n + col]))
+                    pivot = row;
+
+            if (pivot != col)
+            {
+                for (int k = 0; k < n; k++)
+                    std::swap(M[col * n + k], M[pivot * n + k]);
+                std::swap(r[col], r[pivot]);
+            }
+
+            const auto diagonal = M[col * n + col];
+            if (diagonal == 0.0)
+                continue;
+
+            for (int row = col + 1; row < n; row++)
+            {
+                const auto factor = M[row * n + col] / diagonal;
+                for (int k = col; k < n; k++)
+                    M[row * n + k] -= factor * M[col * n + k];
+                r[row] -= factor * r[col];
+            }
+        }
+
+        for (int row = n - 1; row >= 0; row--)
+        {
+            auto sum = r[row];
+            for (int k = row + 1; k < n; k++)
+                sum -= M[row * n + k] * r[k];
+            r[row] = M[row * n + row] != 0.0 ? sum / M[row * n + row] : 0.0;
+        }
+    }
+}
+
+//==============================================================================
+GraphicEQDesigner::GraphicEQDesigner(double fs, int fftLength)
+    : sampleRate(fs)
+{
+    const double centerFrequencies[] = { 63, 125, 250, 500, 1000, 2000, 4000, 8000 };   // Hz
+    const double shelvingCrossover[] = { 46, 11360 };                                   // Hz
+
+    for (int i = 0; i < 8; i++)
+        centerOmega[i] = hertz2rad(centerFrequencies[i], fs);
+    for (int i = 0; i < 2; i++)
+        shelvingOmega[i] = hertz2rad(shelvingCrossover[i], fs);
+
+    targetFrequencies[0] = 1.0;
+    std::copy(std::begin(centerFrequencies), std::end(centerFrequencies), targetFrequencies.begin() + 1);
+    targetFrequencies[numCommandGains - 1] = fs;
+
+    // control frequencies are spaced logarithmically, np.round rounds half to even like nearbyint
+    const auto top = std::log10(fs / 2.1);
+    for (int k = 0; k < numControl; k++)
+        controlFrequencies[k] = std::nearbyint(std::pow(10.0, top * k / (numControl - 1)));
+
+    // design prototype of the biquad sections
+    double prototypeGains[numSections];
+    std::fill(std::begin(prototypeGains), std::end(prototypeGains), prototypeGain);
+    const auto prototype = graphicEQ(centerOmega.data(), shelvingOmega.data(), R, prototypeGains);
+
+    // probeSOS samples freqz on a grid of fftLength bins over [0, fs / 2) and interpolates the dB response,
+    // only the two bins around each control frequency are evaluated here
+    const auto binWidth = fs / (2.0 * fftLength);
+    interaction.resize(numControl * numSections);
+
+    for (int band = 0; band < numSections; band++)
+    {
+        for (int k = 0; k < numControl; k++)
+        {
+            const auto position = controlFrequencies[k] / binWidth;
+            const auto bin = std::min((int)std::floor(position), fftLength - 1);
+            const auto lower = magnitudeIndB(prototype[band], hertz2rad(bin * binWidth, fs));
+
+            double g = lower;
+            if (bin < fftLength - 1)
+            {
+                const auto upper = magnitudeIndB(prototype[band], hertz2rad((bin + 1) * binWidth, fs));
+                g = (upper - lower) / binWidth * (controlFrequencies[k] - bin * binWidth) + lower;
+            }
+
+            interaction[k * numSections + band] = g / prototypeGain;
+        }
+    }
+}
+
+GraphicEQDesigner::SOS GraphicEQDesigner::design(const std::array<double, numCommandGains>& targetGains) const
+{
+    // target magnitude response via command gains
+    std::vector<double> targetInterp(numControl);
+    for (int k = 0; k < numControl; k++)
+        targetInterp[k] = interp(controlFrequencies[k], targetFrequencies.data(), targetGains.data(), numCommandGains);
+
+    // broadband gain is free, every filter section is limited to twice the prototype gain
+    std::vector<double> upperBound(numSections, 2.0 * prototypeGain);
+    upperBound[0] = std::numeric_limits<double>::infinity();
+    std::vector<double> lowerBound(numSections);
+    for (int i = 0; i < numSections; i++)
+        lowerBound[i] = -upperBound[i];
+
+    const auto optG = solveBoundedLeastSquares(interaction, targetInterp, numControl, numSections, lowerBound, upperBound);
+    return graphicEQ(centerOmega.data(), shelvingOmega.data(), R, optG.data());
+}
+
+//==============================================================================
+GraphicEQDesigner::SOS GraphicEQDesigner::graphicEQ(const double* center, const double* shelving, double r, const double* gaindB)
+{
+    SOS sos;
+    const auto Q = std::sqrt(r) / (r - 1.0);
+
+    for (int band = 0; band < numSections; band++)
+    {
+        const auto gain = std::pow(10.0, gaindB[band] / 20.0);
+
+        if (band == 0)
+            sos[band] = { gain, 0.0, 0.0, 1.0, 0.0, 0.0 };
+        else if (band == 1)
+            sos[band] = shelvingFilter(shelving[0], gain, false);
+        else if (band == numSections - 1)
+            sos[band] = shelvingFilter(shelving[1], gain, true);
+        else
+            sos[band] = bandpassFilter(center[band - 2], gain, Q);
+    }
+
+    return sos;
+}
+
+GraphicEQDesigner::Section GraphicEQDesigner::shelvingFilter(double omegaC, double gain, bool highShelf)
+{
+    const auto t = std::tan(omegaC / 2.0);
+    const auto t2 = t * t;
+    const auto g2 = std::pow(gain, 0.5);
+    const auto g4 = std::pow(gain, 0.25);
+    const auto sqrt2 = std::sqrt(2.0);
+
+    double b[3], a[3];
+    b[0] = g2 * (g2 * t2 + sqrt2 * t * g4 + 1.0);
+    b[1] = g2 * (2.0 * g2 * t2 - 2.0);
+    b[2] = g2 * (g2 * t2 - sqrt2 * t * g4 + 1.0);
+
+    a[0] = g2 + sqrt2 * t * g4 + t2;
+    a[1] = 2.0 * t2 - 2.0 * g2;
+    a[2] = g2 - sqrt2 * t * g4 + t2;
+
+    if (highShelf)
+        return { a[0] * gain, a[1] * gain, a[2] * gain, b[0], b[1], b[2] };
+
+    return { b[0], b[1], b[2], a[0], a[1], a[2] };
+}
+
+GraphicEQDesigner::Section GraphicEQDesigner::bandpassFilter(double omegaC, double gain, double Q)
+{
+    const auto bandWidth = omegaC / Q;
+    const auto t = std::tan(bandWidth / 2.0);
+    const auto sqrtGain = std::sqrt(gain);
+
+    return { sqrtGain + gain * t, -2.0 * sqrtGain * std::cos(omegaC), sqrtGain - gain * t,
+             sqrtGain + t,        -2.0 * sqrtGain * std::cos(omegaC), sqrtGain - t };
+}
+
+//==============================================================================
+std::vector<double> GraphicEQDesigner::solveBoundedLeastSquares(const std::vector<double>& A, const std::vector<double>& b, int rows, int cols,
+                                                                const std::vector<double>& lower, const std::vector<double>& upper)
+{
+    // primal active set method on the normal equations H x = c, H = A'A, c = A'b
+    std::vector<double> H(cols * cols, 0.0), c(cols, 0.0);
+    for (int i = 0; i < cols; i++)
+    {
+        for (int j = 0; j < cols; j++)
+        {
+            double sum = 0.0;
+            for (int k = 0; k < rows; k++)
+                sum += A[k * cols + i] * A[k * cols + j];
+            H[i * cols + j] = sum;
+        }
+
+        double sum = 0.0;
+        for (int k = 0; k < rows; k++)
+            sum += A[k * cols + i] * b[k];
+        c[i] = sum;
+    }
+
+    // 0 is free, -1 pinned to the lower bound, +1 pinned to the upper bound
+    std::vector<int> state(cols, 0);
+    std::vector<double> x(cols);
+    for (int i = 0; i < cols; i++)
+        x[i] = std::min(std::max(0.0, lower[i]), upper[i]);
+
+    std::vector<double> gradient(cols), step(cols);
+    std::vector<int> freeSet;
+
+    for (int iteration = 0; iteration < 50 * cols; iteration++)
+    {
+        for (int i = 0; i < cols; i++)
+        {
+            double sum = -c[i];
+            for (int j = 0; j < cols; j++)
+                sum += H[i * cols + j] * x[j];
+            gradient[i] = sum;
+        }
+
+        freeSet.clear();
+        for (int i = 0; i < cols; i++)
+            if (state[i] == 0)
+                freeSet.push_back(i);
+
+        // Newton step on the free variables with the pinned ones held
+        const auto n = (int)freeSet.size();
+        std::vector<double> M(n * n), r(n);
+        for (int i = 0; i < n; i++)
+        {
+            for (int j = 0; j < n; j++)
+                M[i * n + j] = H[freeSet[i] * cols + freeSet[j]];
+            r[i] = -gradient[freeSet[i]];
+        }
+        solveLinearSystem(M, r, n);
+
+        std::fill(step.begin(), step.end(), 0.0);
+        double stepNorm = 0.0, xNorm = 0.0;
+        for (int i = 0; i < n; i++)
+        {
+            step[freeSet[i]] = r[i];
+            stepNorm = std::max(stepNorm, std::abs(r[i]));
+        }
+        for (auto v : x)
+            xNorm = std::max(xNorm, std::abs(v));
+
+        if (stepNorm <= 1e-12 * (1.0 + xNorm))
+        {
+            // optimal for this working set, release the pinned variable whose multiplier has the wrong sign
+            int release = -1;
+            double worst = -1e-12 * (1.0 + std::abs(c[0]));
+            for (int i = 0; i < cols; i++)
+            {
+                if (state[i] == 0)
+                    continue;
+
+                const auto multiplier = state[i] < 0 ? gradient[i] : -gradient[i];
+                if (multiplier < worst)
+                {
+                    worst = multiplier;
+                    release = i;
+                }
+            }
+
+            if (release < 0)
+                break;
+
+            state[release] = 0;
+            continue;
+        }
+
+        // longest feasible fraction of the step, the first bound hit joins the working set
+        double alpha = 1.0;
+        int blocking = -1, blockingSide = 0;
+        for (auto i : freeSet)
+        {
+            if (step[i] < 0.0 && std::isfinite(lower[i]))
+            {
+                const auto limit = (lower[i] - x[i]) / step[i];
+                if (limit < alpha)
+                {
+                    alpha = limit;
+                    blocking = i;
+                    blockingSide = -1;
+                }
+            }
+            else if (step[i] > 0.0 && std::isfinite(upper[i]))
+            {
+                const auto limit = (upper[i] - x[i]) / step[i];
+                if (limit < alpha)
+                {
+                    alpha = limit;
+                    blocking = i;
+                    blockingSide = 1;
+                }
+            }
+        }
+
+        alpha = std::max(alpha, 0.0);
+        for (auto i : freeSet)
+            x[i] += alpha * step[i];
+
+        if (blocking >= 0)
+        {
+            x[blocking] = blockingSide < 0 ? lower[blocking] : upper[blocking];
+            state[blocking] = blockingSide;
+        }
+    }
+
+    return x;
+}
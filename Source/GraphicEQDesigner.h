@@ -0,0 +1,53 @@
+/*
+  ==============================================================================
+
+    GraphicEQDesigner.h
+
+    Native port of designGEQ / graphicEQ / probeSOS from external.py. The
+    prototype interaction matrix only depends on the sample rate, so it is
+    built once per designer and every design is a bounded least squares
+    solve on an 101 x 11 system followed by the biquad formulas.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <array>
+#include <vector>
+
+class GraphicEQDesigner
+{
+public:
+    // broadband gain, low shelf, 8 octave bandpass sections, high shelf
+    static constexpr int numSections = 11;
+    static constexpr int numCommandGains = 10;
+    static constexpr int numControl = 101;
+
+    // { b0, b1, b2, a0, a1, a2 }, not normalised, same layout as the Python SOS rows
+    using Section = std::array<double, 6>;
+    using SOS = std::array<Section, numSections>;
+
+    // fftLength is the freqz grid of probeSOS, kept so the matrix matches the Python design bit for bit
+    explicit GraphicEQDesigner(double sampleRate = 48000.0, int fftLength = 1 << 16);
+
+    /** targetGains are the command gains in dB at [1 Hz, 63 ... 8000 Hz, fs], as passed to designGEQ. */
+    SOS design(const std::array<double, numCommandGains>& targetGains) const;
+
+    static SOS graphicEQ(const double* centerOmega, const double* shelvingOmega, double R, const double* gaindB);
+    static Section shelvingFilter(double omegaC, double gain, bool highShelf);
+    static Section bandpassFilter(double omegaC, double gain, double Q);
+
+    /** min |A x - b|^2 subject to lower <= x <= upper, A is rows x cols in row major order. */
+    static std::vector<double> solveBoundedLeastSquares(const std::vector<double>& A, const std::vector<double>& b, int rows, int cols,
+                                                        const std::vector<double>& lower, const std::vector<double>& upper);
+
+private:
+    double sampleRate;
+    std::array<double, 8> centerOmega;
+    std::array<double, 2> shelvingOmega;
+    std::array<double, numCommandGains> targetFrequencies;
+    std::array<double, numControl> controlFrequencies;
+    // prototype response in dB per dB of command gain, numControl x numSections, row major
+    std::vector<double> interaction;
+};
@@ -0,0 +1,109 @@
+/*
+  ==============================================================================
+
+    HybridSplit.cpp
+
+  ==============================================================================
+*/
+
+#include "HybridSplit.h"
+#include <numeric>
+
+double HybridSplit::estimateMixingTime(const juce::AudioBuffer<float>& impulseResponse, double sampleRate)
+{
+	const auto numSamples = impulseResponse.getNumSamples();
+	const auto numChannels = impulseResponse.getNumChannels();
+	if (numSamples == 0 || numChannels == 0 || sampleRate <= 0.0)
+		return 0.0;
+
+	// channels summed, the density of the reflections does not depend on the ear
+	std::vector<float> mono((size_t)numSamples, 0.0f);
+	for (int channel = 0; channel < numChannels; channel++)
+		juce::FloatVectorOperations::add(mono.data(), impulseResponse.getReadPointer(channel), numSamples);
+
+	// the direct sound, the sparse early part is everything after it
+	const auto onset = (int)std::distance(mono.begin(), std::max_element(mono.begin(), mono.end(),
+		[](float a, float b) { return std::abs(a) < std::abs(b); }));
+
+	// 20 ms Hann window moved in 1 ms hops
+	const auto windowLength = juce::jmax(16, (int)(0.02 * sampleRate)) | 1;
+	const auto hop = juce::jmax(1, (int)(0.001 * sampleRate));
+	std::vector<double> window((size_t)windowLength);
+	for (int i = 0; i < windowLength; i++)
+		window[(size_t)i] = 0.5 - 0.5 * std::cos(2.0 * juce::MathConstants<double>::pi * (i + 1) / (windowLength + 1));
+	const auto windowSum = std::accumulate(window.begin(), window.end(), 0.0);
+	for (auto& w : window)
+		w /= windowSum;
+
+	// a Gaussian has erfc(1 / sqrt(2)) of its samples outside one standard deviation
+	const auto gaussianOutside = std::erfc(1.0 / std::sqrt(2.0));
+
+	for (int start = onset; start + windowLength <= numSamples; start += hop)
+	{
+		const auto* frame = mono.data() + start;
+
+		double variance = 0.0;
+		for (int i = 0; i < windowLength; i++)
+			variance += window[(size_t)i] * frame[i] * frame[i];
+		const auto deviation = std::sqrt(variance);
+
+		double outside = 0.0;
+		for (int i = 0; i < windowLength; i++)
+		{
+			if (std::abs(frame[i]) > deviation)
+				outside += window[(size_t)i];
+		}
+
+		if (outside / gaussianOutside >= 1.0)
+			return (start + windowLength / 2) / sampleRate;
+	}
+
+	return numSamples / sampleRate;
+}
+
+float HybridSplit::getNormalisationGain(const juce::AudioBuffer<float>& impulseResponse, double impulseResponseRate, double processingRate)
+{
+	double maxEnergy = 0.0;
+	for (int channel = 0; channel < impulseResponse.getNumChannels(); channel++)
+	{
+		const auto* data = impulseResponse.getReadPointer(channel);
+		maxEnergy = juce::jmax(maxEnergy, std::inner_product(data, data + impulseResponse.getNumSamples(), data, 0.0));
+	}
+
+	// resampling keeps the amplitude, so the energy grows with the number of samples
+	if (impulseResponseRate > 0.0 && processingRate > 0.0)
+		maxEnergy *= processingRate / impulseResponseRate;
+
+	return maxEnergy > 0.0 ? (float)(1.0 / std::sqrt(maxEnergy)) : 1.0f;
+}
+
+void HybridSplit::truncate(juce::AudioBuffer<float>& impulseResponse, int start, int length)
+{
+	start = juce::jlimit(0, impulseResponse.getNumSamples(), start);
+	length = juce::jlimit(0, impulseResponse.getNumSamples() - start, length);
+
+	for (int channel = 0; channel < impulseResponse.getNumChannels(); channel++)
+	{
+		auto* data = impulseResponse.getWritePointer(channel, start);
+		for (int i = 0; i < length; i++)
+			data[i] *= (float)std::cos(0.5 * juce::MathConstants<double>::pi * (i + 0.5) / length);
+	}
+
+	impulseResponse.setSize(impulseResponse.getNumChannels(), start + length, true);
+}
+
+double HybridSplit::getMeanPower(const juce::AudioBuffer<float>& buffer, int start, int length)
+{
+	const auto end = juce::jmin(buffer.getNumSamples(), start + length);
+	start = juce::jmax(0, start);
+	if (end <= start || buffer.getNumChannels() == 0)
+		return 0.0;
+
+	double energy = 0.0;
+	for (int channel = 0; channel < buffer.getNumChannels(); channel++)
+	{
+		const auto* data = buffer.getReadPointer(channel);
+		energy = std::inner_product(data + start, data + end, data + start, energy);
+	}
+	return energy / ((double)(end - start) * buffer.getNumChannels());
+}
@@ -0,0 +1,39 @@
+/*
+  ==============================================================================
+
+    HybridSplit.h
+
+    Helpers for the hybrid mode, where the convolution only renders the
+    early part of a room impulse response and the feedback delay network
+    takes over at the mixing time. The mixing time is where the normalised
+    echo density (Abel & Huang) of the response first reaches that of
+    Gaussian noise, i.e. where the reflections have become diffuse enough
+    for a statistical late reverb model.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+namespace HybridSplit
+{
+	/** Mixing time in seconds from the start of the response, searched after its strongest peak.
+		Responses that never become diffuse return their length.
+	*/
+	double estimateMixingTime(const juce::AudioBuffer<float>& impulseResponse, double sampleRate);
+
+	/** The factor juce::dsp::Convolution::Normalise::yes would scale every channel by at the processing
+		rate, so a part cut out afterwards keeps the level it has in the full-length response.
+	*/
+	float getNormalisationGain(const juce::AudioBuffer<float>& impulseResponse, double impulseResponseRate, double processingRate);
+
+	/** Fades all channels out over [start, start + length) with an equal power curve and cuts the rest,
+		the fade-in counterpart being the uncorrelated build-up of the network.
+	*/
+	void truncate(juce::AudioBuffer<float>& impulseResponse, int start, int length);
+
+	/** Mean power per sample over all channels in [start, start + length), 0 outside the buffer. */
+	double getMeanPower(const juce::AudioBuffer<float>& buffer, int start, int length);
+}
@@ -0,0 +1,95 @@
+/*
+  ==============================================================================
+
+    OutputStage.h
+
+    Final mix of the processor: dry, convolution and feedback delay network
+    summed into the output in one pass per channel. The gains are read once
+    per block and ramp linearly from the values the previous block ended on,
+    so automation never steps. The ramp is computed from the sample index
+    rather than accumulated, which leaves no dependency between iterations
+    and lets the compiler vectorise the loop. Runs at host precision, only
+    the convolution is always float.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+class OutputStage
+{
+public:
+	enum { dry, convolution, network, numGains };
+
+	OutputStage()
+	{
+	};
+
+	~OutputStage()
+	{
+	};
+
+	/** Jumps to the given gains without a ramp, e.g. from prepareToPlay. */
+	void reset(float dryGain, float convolutionGain, float networkGain) noexcept
+	{
+		gains[dry] = dryGain;
+		gains[convolution] = convolutionGain;
+		gains[network] = networkGain;
+	}
+
+	/** The gain the last block ended on, see the enum for the index. */
+	float getGain(int index) const noexcept                     { return gains[index]; }
+
+	/** Mixes one block of every channel, ramping each gain to its new value by the last sample.
+		The convolution channels may be the output channels.
+	*/
+	template <typename SampleType>
+	void process(const SampleType* const* dryChannels, const float* const* convolutionChannels, const SampleType* const* networkChannels,
+	             SampleType* const* outputChannels, int numChannels, int numSamples,
+	             float dryGain, float convolutionGain, float networkGain) noexcept;
+
+private:
+	template <typename SampleType>
+	static void mixChannel(const SampleType* dryChannel, const float* convolutionChannel, const SampleType* networkChannel, SampleType* output,
+	                       int numSamples, const float (&start)[numGains], const float (&step)[numGains]) noexcept;
+
+	float gains[numGains] = { 0.0f, 0.0f, 0.0f };
+};
+
+template <typename SampleType>
+void OutputStage::process(const SampleType* const* dryChannels, const float* const* convolutionChannels, const SampleType* const* networkChannels,
+                          SampleType* const* outputChannels, int numChannels, int numSamples,
+                          float dryGain, float convolutionGain, float networkGain) noexcept
+{
+	if (numSamples <= 0)
+		return;
+
+	const float targets[numGains] = { dryGain, convolutionGain, networkGain };
+	float step[numGains];
+	for (int g = 0; g < numGains; g++)
+		step[g] = (targets[g] - gains[g]) / (float)numSamples;
+
+	// every channel follows the same ramp
+	for (int channel = 0; channel < numChannels; channel++)
+		mixChannel(dryChannels[channel], convolutionChannels[channel], networkChannels[channel], outputChannels[channel], numSamples, gains, step);
+
+	std::copy(std::begin(targets), std::end(targets), std::begin(gains));
+}
+
+template <typename SampleType>
+void OutputStage::mixChannel(const SampleType* dryChannel, const float* convolutionChannel, const SampleType* networkChannel, SampleType* output,
+                             int numSamples, const float (&start)[numGains], const float (&step)[numGains]) noexcept
+{
+	const auto dryStart = (SampleType)start[dry], convolutionStart = (SampleType)start[convolution], networkStart = (SampleType)start[network];
+	const auto dryStep = (SampleType)step[dry], convolutionStep = (SampleType)step[convolution], networkStep = (SampleType)step[network];
+
+	for (int i = 0; i < numSamples; i++)
+	{
+		const auto t = (SampleType)(i + 1);
+		output[i] = dryChannel[i] * (dryStart + dryStep * t)
+		          + (SampleType)convolutionChannel[i] * (convolutionStart + convolutionStep * t)
+		          + networkChannel[i] * (networkStart + networkStep * t);
+	}
+}
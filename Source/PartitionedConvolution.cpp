@@ -0,0 +1,707 @@
+/*
+  ==============================================================================
+
+    PartitionedConvolution.cpp
+
+  ==============================================================================
+*/
+
+#include "PartitionedConvolution.h"
+#include "TraceRecorder.h"
+#include "WorkerSignal.h"
+#include <numeric>
+
+namespace
+{
+	// partition sizes of the tail levels grow by this factor up to the largest block
+	constexpr int levelGrowth = 8;
+	constexpr int largestLevelBlock = 8192;
+
+	// a new response fades in while the one before fades out, as long as juce::dsp::Convolution takes
+	constexpr double crossfadeSeconds = 0.05;
+
+	// bins 0 .. fftSize / 2 of a real-only transform, interleaved
+	int getSpectrumSize(int fftSize)                    { return fftSize + 2; }
+
+	// the real-only transform leaves the negative frequencies out, the inverse needs them
+	void mirrorSpectrum(float* spectrum, int fftSize) noexcept
+	{
+		for (int bin = fftSize / 2 + 1; bin < fftSize; bin++)
+		{
+			spectrum[2 * bin] = spectrum[2 * (fftSize - bin)];
+			spectrum[2 * bin + 1] = -spectrum[2 * (fftSize - bin) + 1];
+		}
+	}
+
+	// accumulator += a * b, bin by bin
+	void multiplyAccumulate(float* accumulator, const float* a, const float* b, int spectrumSize) noexcept
+	{
+		for (int i = 0; i < spectrumSize; i += 2)
+		{
+			accumulator[i]     += a[i] * b[i]     - a[i + 1] * b[i + 1];
+			accumulator[i + 1] += a[i] * b[i + 1] + a[i + 1] * b[i];
+		}
+	}
+}
+
+//==============================================================================
+class PartitionedConvolution::Engine
+{
+public:
+	// ir holds one pointer per output channel, read but not kept
+	Engine(const float* const* ir, int numSamples, float gain, int headBlockSize, bool useBackgroundThread, std::atomic<int>& missCounter)
+		: irSize(numSamples), deadlineMisses(missCounter)
+	{
+		// the head covers the first two blocks of the first level, so that level starts with a block of slack
+		const int firstLevelBlock = headBlockSize * 4;
+		head.prepare(ir, gain, 0, juce::jmin(irSize, 2 * firstLevelBlock), headBlockSize);
+
+		for (int blockSize = firstLevelBlock; 2 * blockSize < irSize;)
+		{
+			const int nextBlockSize = juce::jmin(blockSize * levelGrowth, largestLevelBlock);
+			const int end = nextBlockSize > blockSize ? juce::jmin(irSize, 2 * nextBlockSize) : irSize;
+
+			levels.push_back(std::make_unique<Level>());
+			levels.back()->prepare(ir, gain, 2 * blockSize, end, blockSize);
+
+			if (end == irSize)
+				break;
+
+			blockSize = nextBlockSize;
+		}
+
+		if (useBackgroundThread && !levels.empty())
+		{
+			// the audio thread waits for this one when it runs late, so it must not queue behind ordinary threads
+			worker = std::make_unique<Worker>(*this);
+			if (!worker->startRealtimeThread(juce::Thread::RealtimeOptions{}))
+				worker->startThread(juce::Thread::Priority::highest);
+		}
+	}
+
+	~Engine()
+	{
+		// before the levels it runs
+		worker.reset();
+	}
+
+	int getIRSize() const noexcept              { return irSize; }
+
+	// link in the collector's list of engines to free
+	Engine* nextRetired = nullptr;
+	Handover handover;
+
+	void reset() noexcept
+	{
+		head.reset();
+		for (auto& level : levels)
+			level->reset();
+
+		time = 0;
+	}
+
+	void process(float* const* channels, int numSamples) noexcept
+	{
+		for (int done = 0; done < numSamples;)
+		{
+			// chunks never cross a head block, and every level block is a whole number of head blocks
+			const int numChunk = juce::jmin(numSamples - done, head.blockSize - head.position);
+			float* chunk[numChannels] = { channels[0] + done, channels[1] + done };
+
+			for (auto& level : levels)
+				level->pushInput(chunk, numChunk, time);
+
+			head.process(chunk, numChunk);
+
+			for (auto& level : levels)
+				level->addOutput(chunk, numChunk, time);
+
+			time += numChunk;
+			done += numChunk;
+
+			for (auto& level : levels)
+			{
+				if (time % level->blockSize != 0)
+					continue;
+
+				// the block before the one that just completed is audible from now on
+				const auto completed = time / level->blockSize - 1;
+				if (completed > 0)
+					finishTask(*level);
+
+				level->submit(completed);
+				if (worker != nullptr)
+					worker->workAvailable.signal();
+			}
+		}
+	}
+
+private:
+	static constexpr int numChannels = 2;
+
+	enum TaskState { idle, pending, running };
+
+	//==============================================================================
+	/** Zero-latency uniform partitions on the audio thread (overlap-add). The current block is
+		transformed again at every call, the older partitions are summed once per block.
+	*/
+	struct Head
+	{
+		void prepare(const float* const* ir, float gain, int start, int end, int size)
+		{
+			blockSize = size;
+			fftSize = 2 * size;
+			spectrumSize = getSpectrumSize(fftSize);
+			fft = std::make_unique<juce::dsp::FFT>(juce::roundToInt(std::log2(fftSize)));
+			numPartitions = juce::jmax(1, (end - start + size - 1) / size);
+
+			work.assign((size_t)(2 * fftSize), 0.0f);
+			sum.assign((size_t)(2 * fftSize), 0.0f);
+
+			for (int channel = 0; channel < numChannels; channel++)
+			{
+				auto& c = channels[channel];
+				c.partitions.assign((size_t)(numPartitions * spectrumSize), 0.0f);
+				c.inputSpectra.assign((size_t)(numPartitions * spectrumSize), 0.0f);
+				c.olderPartitions.assign((size_t)spectrumSize, 0.0f);
+				c.overlap.assign((size_t)size, 0.0f);
+				c.input.assign((size_t)size, 0.0f);
+
+				for (int p = 0; p < numPartitions; p++)
+				{
+					std::fill(work.begin(), work.end(), 0.0f);
+					const int offset = start + p * size;
+					const int length = juce::jmax(0, juce::jmin(size, end - offset));
+					juce::FloatVectorOperations::copyWithMultiply(work.data(), ir[channel] + offset, gain, length);
+					fft->performRealOnlyForwardTransform(work.data(), true);
+					std::copy(work.begin(), work.begin() + spectrumSize, c.partitions.begin() + p * spectrumSize);
+				}
+			}
+
+			reset();
+		}
+
+		void reset() noexcept
+		{
+			for (auto& c : channels)
+			{
+				std::fill(c.inputSpectra.begin(), c.inputSpectra.end(), 0.0f);
+				std::fill(c.overlap.begin(), c.overlap.end(), 0.0f);
+				std::fill(c.input.begin(), c.input.end(), 0.0f);
+			}
+			position = 0;
+			index = 0;
+		}
+
+		void process(float* const* data, int numSamples) noexcept
+		{
+			for (int channel = 0; channel < numChannels; channel++)
+			{
+				auto& c = channels[channel];
+
+				if (position == 0)
+				{
+					std::fill(c.olderPartitions.begin(), c.olderPartitions.end(), 0.0f);
+					for (int p = 1; p < numPartitions; p++)
+					{
+						const int slot = (index - p + numPartitions) % numPartitions;
+						multiplyAccumulate(c.olderPartitions.data(), c.inputSpectra.data() + slot * spectrumSize, c.partitions.data() + p * spectrumSize, spectrumSize);
+					}
+				}
+
+				std::copy(data[channel], data[channel] + numSamples, c.input.begin() + position);
+				std::copy(c.input.begin(), c.input.end(), work.begin());
+				std::fill(work.begin() + blockSize, work.end(), 0.0f);
+				fft->performRealOnlyForwardTransform(work.data(), true);
+
+				// the last transform of a block sees the whole block, that is the one older blocks reuse
+				std::copy(work.begin(), work.begin() + spectrumSize, c.inputSpectra.begin() + index * spectrumSize);
+
+				std::copy(c.olderPartitions.begin(), c.olderPartitions.end(), sum.begin());
+				multiplyAccumulate(sum.data(), work.data(), c.partitions.data(), spectrumSize);
+				mirrorSpectrum(sum.data(), fftSize);
+				fft->performRealOnlyInverseTransform(sum.data());
+
+				for (int i = 0; i < numSamples; i++)
+					data[channel][i] = sum[(size_t)(position + i)] + c.overlap[(size_t)(position + i)];
+
+				if (position + numSamples == blockSize)
+					std::copy(sum.begin() + blockSize, sum.begin() + fftSize, c.overlap.begin());
+			}
+
+			position += numSamples;
+			if (position == blockSize)
+			{
+				position = 0;
+				index = (index + 1) % numPartitions;
+				for (auto& c : channels)
+					std::fill(c.input.begin(), c.input.end(), 0.0f);
+			}
+		}
+
+		struct Channel
+		{
+			std::vector<float> partitions, inputSpectra, olderPartitions, overlap, input;
+		};
+
+		int blockSize = 0, fftSize = 0, spectrumSize = 0, numPartitions = 0;
+		int position = 0, index = 0;
+		std::unique_ptr<juce::dsp::FFT> fft;
+		Channel channels[numChannels];
+		std::vector<float> work, sum;
+	};
+
+	//==============================================================================
+	/** Uniform partitions of one tail segment (overlap-save), computed a whole block at a time
+		by whoever claims the task first. The segment starts two blocks into the response.
+	*/
+	struct Level
+	{
+		void prepare(const float* const* ir, float gain, int start, int end, int size)
+		{
+			jassert(start == 2 * size);
+
+			blockSize = size;
+			fftSize = 2 * size;
+			spectrumSize = getSpectrumSize(fftSize);
+			fft = std::make_unique<juce::dsp::FFT>(juce::roundToInt(std::log2(fftSize)));
+			numPartitions = (end - start + size - 1) / size;
+
+			work.assign((size_t)(2 * fftSize), 0.0f);
+			sum.assign((size_t)(2 * fftSize), 0.0f);
+
+			for (int channel = 0; channel < numChannels; channel++)
+			{
+				auto& c = channels[channel];
+				c.partitions.assign((size_t)(numPartitions * spectrumSize), 0.0f);
+				c.inputSpectra.assign((size_t)(numPartitions * spectrumSize), 0.0f);
+				c.inputs.assign((size_t)(3 * size), 0.0f);
+				c.outputs.assign((size_t)(2 * size), 0.0f);
+
+				for (int p = 0; p < numPartitions; p++)
+				{
+					std::fill(work.begin(), work.end(), 0.0f);
+					const int offset = start + p * size;
+					const int length = juce::jmin(size, end - offset);
+					juce::FloatVectorOperations::copyWithMultiply(work.data(), ir[channel] + offset, gain, length);
+					fft->performRealOnlyForwardTransform(work.data(), true);
+					std::copy(work.begin(), work.begin() + spectrumSize, c.partitions.begin() + p * spectrumSize);
+				}
+			}
+
+			reset();
+		}
+
+		void reset() noexcept
+		{
+			for (auto& c : channels)
+			{
+				std::fill(c.inputSpectra.begin(), c.inputSpectra.end(), 0.0f);
+				std::fill(c.inputs.begin(), c.inputs.end(), 0.0f);
+				std::fill(c.outputs.begin(), c.outputs.end(), 0.0f);
+			}
+			index = 0;
+			state = idle;
+		}
+
+		// input block k fills slot k % 3 while the task reads the two blocks before it
+		void pushInput(float* const* data, int numSamples, juce::int64 time) noexcept
+		{
+			const auto offset = (int)(time % blockSize) + (int)((time / blockSize) % 3) * blockSize;
+			for (int channel = 0; channel < numChannels; channel++)
+				std::copy(data[channel], data[channel] + numSamples, channels[channel].inputs.begin() + offset);
+		}
+
+		// the result of block k is heard during block k + 2, from slot k % 2
+		void addOutput(float* const* data, int numSamples, juce::int64 time) const noexcept
+		{
+			const auto block = time / blockSize - 2;
+			if (block < 0)
+				return;
+
+			const auto offset = (int)(time % blockSize) + (int)(block % 2) * blockSize;
+			for (int channel = 0; channel < numChannels; channel++)
+			{
+				const auto* result = channels[channel].outputs.data() + offset;
+				for (int i = 0; i < numSamples; i++)
+					data[channel][i] += result[i];
+			}
+		}
+
+		void submit(juce::int64 block) noexcept
+		{
+			taskBlock = block;
+			deadline = (block + 2) * blockSize;
+			state.store(pending, std::memory_order_release);
+		}
+
+		void run() noexcept
+		{
+			const auto block = taskBlock;
+
+			for (int channel = 0; channel < numChannels; channel++)
+			{
+				auto& c = channels[channel];
+				const auto* previous = c.inputs.data() + ((block + 2) % 3) * blockSize;
+				const auto* latest = c.inputs.data() + (block % 3) * blockSize;
+
+				std::copy(previous, previous + blockSize, work.begin());
+				std::copy(latest, latest + blockSize, work.begin() + blockSize);
+				std::fill(work.begin() + fftSize, work.end(), 0.0f);
+				fft->performRealOnlyForwardTransform(work.data(), true);
+				std::copy(work.begin(), work.begin() + spectrumSize, c.inputSpectra.begin() + index * spectrumSize);
+
+				std::fill(sum.begin(), sum.end(), 0.0f);
+				for (int p = 0; p < numPartitions; p++)
+				{
+					const int slot = (index - p + numPartitions) % numPartitions;
+					multiplyAccumulate(sum.data(), c.inputSpectra.data() + slot * spectrumSize, c.partitions.data() + p * spectrumSize, spectrumSize);
+				}
+				mirrorSpectrum(sum.data(), fftSize);
+				fft->performRealOnlyInverseTransform(sum.data());
+
+				// overlap-save: the second half is the clean part
+				std::copy(sum.begin() + blockSize, sum.begin() + fftSize, c.outputs.begin() + (block % 2) * blockSize);
+			}
+
+			index = (index + 1) % numPartitions;
+		}
+
+		struct Channel
+		{
+			std::vector<float> partitions, inputSpectra, inputs, outputs;
+		};
+
+		int blockSize = 0, fftSize = 0, spectrumSize = 0, numPartitions = 0;
+		int index = 0;
+		std::unique_ptr<juce::dsp::FFT> fft;
+		Channel channels[numChannels];
+		std::vector<float> work, sum;
+
+		std::atomic<int> state{ idle };
+		juce::int64 taskBlock = 0;
+		juce::int64 deadline = 0;
+	};
+
+	//==============================================================================
+	class Worker : public juce::Thread
+	{
+	public:
+		explicit Worker(Engine& e) : juce::Thread("NN partitioned convolution"), engine(e) {}
+
+		~Worker() override
+		{
+			// the signal gets it out of a sleeping wait
+			signalThreadShouldExit();
+			workAvailable.signal();
+			stopThread(2000);
+		}
+
+		void run() override
+		{
+			while (!threadShouldExit())
+			{
+				if (!engine.runEarliestTask())
+					workAvailable.wait();
+			}
+		}
+
+		WorkerSignal workAvailable;
+
+	private:
+		Engine& engine;
+	};
+
+	// worker side: the pending level with the earliest deadline first
+	bool runEarliestTask() noexcept
+	{
+		Level* earliest = nullptr;
+		for (auto& level : levels)
+		{
+			if (level->state.load(std::memory_order_acquire) == pending && (earliest == nullptr || level->deadline < earliest->deadline))
+				earliest = level.get();
+		}
+
+		if (earliest == nullptr)
+			return false;
+
+		auto expected = (int)pending;
+		if (earliest->state.compare_exchange_strong(expected, running, std::memory_order_acquire))
+		{
+			earliest->run();
+			earliest->state.store(idle, std::memory_order_release);
+		}
+		return true;
+	}
+
+	// audio side: the result is due now, take the task over if nobody started it yet
+	void finishTask(Level& level) noexcept
+	{
+		auto expected = (int)pending;
+		if (level.state.compare_exchange_strong(expected, running, std::memory_order_acquire))
+		{
+			if (worker != nullptr)
+				++deadlineMisses;
+
+			level.run();
+			level.state.store(idle, std::memory_order_release);
+			return;
+		}
+
+		// the worker is inside run() and at realtime priority, so this lasts at most the rest of one task
+		if (expected == running)
+		{
+			++deadlineMisses;
+			while (level.state.load(std::memory_order_acquire) == running)
+				WorkerSignal::pause();
+		}
+	}
+
+	const int irSize;
+	std::atomic<int>& deadlineMisses;
+	Head head;
+	std::vector<std::unique_ptr<Level>> levels;
+	juce::int64 time = 0;
+	std::unique_ptr<Worker> worker;
+};
+
+//==============================================================================
+/** Frees the engines process() swapped out, so neither the audio thread nor the next load has to.
+	One thread for every instance in the process, started with the first load and asleep until
+	an engine arrives.
+*/
+class PartitionedConvolution::Collector : private juce::Thread
+{
+public:
+	Collector() : juce::Thread("NN convolution collector") {}
+
+	~Collector() override
+	{
+		signalThreadShouldExit();
+		retiredAvailable.signal();
+		stopThread(2000);
+		freeRetiredEngines();
+	}
+
+	// any thread but the audio thread
+	void startIfNeeded()
+	{
+		const juce::ScopedLock sl(startLock);
+		if (!isThreadRunning())
+			startThread(juce::Thread::Priority::low);
+	}
+
+	// audio thread, engines of any instance
+	void retire(Engine* engine) noexcept
+	{
+		auto* head = retired.load(std::memory_order_relaxed);
+		do
+		{
+			engine->nextRetired = head;
+		}
+		while (!retired.compare_exchange_weak(head, engine, std::memory_order_release, std::memory_order_relaxed));
+
+		retiredAvailable.signal();
+	}
+
+private:
+	void run() override
+	{
+		while (!threadShouldExit())
+		{
+			retiredAvailable.wait();
+			freeRetiredEngines();
+		}
+	}
+
+	void freeRetiredEngines()
+	{
+		for (auto* engine = retired.exchange(nullptr, std::memory_order_acquire); engine != nullptr;)
+		{
+			auto* next = engine->nextRetired;
+			delete engine;
+			engine = next;
+		}
+	}
+
+	juce::CriticalSection startLock;
+	std::atomic<Engine*> retired{ nullptr };
+	WorkerSignal retiredAvailable;
+};
+
+//==============================================================================
+PartitionedConvolution::PartitionedConvolution()
+{
+}
+
+PartitionedConvolution::~PartitionedConvolution()
+{
+	delete pending.exchange(nullptr);
+}
+
+void PartitionedConvolution::prepare(double newSampleRate, int newMaximumBlockSize)
+{
+	const juce::ScopedLock sl(loadLock);
+
+	sampleRate = newSampleRate;
+	maximumBlockSize = newMaximumBlockSize;
+	fadeLength = juce::jmax(1, juce::roundToInt(sampleRate * crossfadeSeconds));
+	fadeBuffer.setSize(2, juce::jmax(1, maximumBlockSize));
+
+	delete pending.exchange(nullptr);
+	fading.reset();
+	current = createEngine();
+	currentIRSize = current != nullptr ? current->getIRSize() : 0;
+}
+
+void PartitionedConvolution::reset()
+{
+	if (fading != nullptr)
+		collector->retire(fading.release());
+
+	if (current != nullptr)
+		current->reset();
+}
+
+void PartitionedConvolution::loadImpulseResponse(std::shared_ptr<const juce::AudioBuffer<float>> newImpulseResponse, double newImpulseResponseRate,
+                                                 bool normalise, int firstChannel, Handover handover)
+{
+	const juce::ScopedLock sl(loadLock);
+
+	impulseResponse = std::move(newImpulseResponse);
+	firstImpulseResponseChannel = firstChannel;
+	impulseResponseRate = newImpulseResponseRate;
+	normaliseImpulseResponse = normalise;
+	impulseResponseHandover = handover;
+
+	// an earlier response the audio thread has not picked up yet is simply replaced
+	if (auto engine = createEngine())
+	{
+		collector->startIfNeeded();
+		delete pending.exchange(engine.release());
+	}
+}
+
+std::unique_ptr<PartitionedConvolution::Engine> PartitionedConvolution::createEngine()
+{
+	if (impulseResponse == nullptr || impulseResponse->getNumSamples() == 0 || impulseResponse->getNumChannels() == 0 || sampleRate <= 0.0)
+		return {};
+
+	const auto& response = *impulseResponse;
+	const float* ir[] = { response.getReadPointer(firstImpulseResponseChannel % response.getNumChannels()),
+	                      response.getReadPointer((firstImpulseResponseChannel + 1) % response.getNumChannels()) };
+	auto irSize = response.getNumSamples();
+
+	// at the processing rate, only the two channels this engine runs and only when the rates differ
+	juce::AudioBuffer<float> resampled;
+	const auto needsResampling = impulseResponseRate > 0.0 && std::abs(impulseResponseRate - sampleRate) > 1.0e-6;
+	if (needsResampling)
+	{
+		const TraceRecorder::Span span("resample impulse response", "convolution");
+		const auto ratio = impulseResponseRate / sampleRate;
+		irSize = (int)std::ceil(response.getNumSamples() / ratio);
+		resampled.setSize(2, irSize);
+
+		for (int channel = 0; channel < 2; channel++)
+		{
+			juce::LagrangeInterpolator interpolator;
+			interpolator.process(ratio, ir[channel], resampled.getWritePointer(channel), irSize, response.getNumSamples(), 0);
+			ir[channel] = resampled.getReadPointer(channel);
+		}
+	}
+
+	// the channel of the whole response with the most energy ends up at unit energy, at the processing rate
+	auto gain = 1.0f;
+	if (normaliseImpulseResponse)
+	{
+		double maxEnergy = 0.0;
+		for (int channel = 0; channel < response.getNumChannels(); channel++)
+		{
+			const auto* data = response.getReadPointer(channel);
+			maxEnergy = juce::jmax(maxEnergy, std::inner_product(data, data + response.getNumSamples(), data, 0.0));
+		}
+
+		// resampling keeps the amplitude, so the energy grows with the number of samples
+		if (needsResampling)
+			maxEnergy *= sampleRate / impulseResponseRate;
+
+		if (maxEnergy > 0.0)
+			gain = (float)(1.0 / std::sqrt(maxEnergy));
+	}
+
+	const auto headBlockSize = juce::jlimit(64, 1024, juce::nextPowerOfTwo(juce::jmax(1, maximumBlockSize)));
+	const TraceRecorder::Span span("transform partitions", "convolution", juce::String(irSize) + " samples");
+	auto engine = std::make_unique<Engine>(ir, irSize, gain, headBlockSize, useBackgroundThread, deadlineMisses);
+	engine->handover = impulseResponseHandover;
+	return engine;
+}
+
+void PartitionedConvolution::switchToPendingResponse() noexcept
+{
+	// a new response takes over at a block boundary and fades in while the old engine keeps running on the same
+	// input and fades out. The first response starts right away, one that arrives during a fade waits for its end
+	if (fading != nullptr)
+		return;
+
+	if (auto* next = pending.exchange(nullptr))
+	{
+		fading = std::move(current);
+		fadePosition = 0;
+		current.reset(next);
+		currentIRSize = next->getIRSize();
+	}
+}
+
+const PartitionedConvolution::Handover* PartitionedConvolution::getCurrentHandover() const noexcept
+{
+	return current != nullptr ? &current->handover : nullptr;
+}
+
+void PartitionedConvolution::process(float* left, float* right, int numSamples) noexcept
+{
+	switchToPendingResponse();
+
+	if (current == nullptr)
+	{
+		juce::FloatVectorOperations::clear(left, numSamples);
+		juce::FloatVectorOperations::clear(right, numSamples);
+		return;
+	}
+
+	float* channels[] = { left, right };
+	if (fading == nullptr)
+	{
+		current->process(channels, numSamples);
+		return;
+	}
+
+	for (int done = 0; done < numSamples;)
+	{
+		const int numChunk = juce::jmin(numSamples - done, fadeBuffer.getNumSamples());
+		float* chunk[] = { left + done, right + done };
+		float* outgoing[] = { fadeBuffer.getWritePointer(0), fadeBuffer.getWritePointer(1) };
+
+		for (int channel = 0; channel < 2; channel++)
+			juce::FloatVectorOperations::copy(outgoing[channel], chunk[channel], numChunk);
+
+		fading->process(outgoing, numChunk);
+		current->process(chunk, numChunk);
+
+		// linear, the two responses of a room are mostly alike, so their sum keeps its level
+		for (int channel = 0; channel < 2; channel++)
+		{
+			for (int i = 0; i < numChunk; i++)
+			{
+				const auto gain = juce::jmin(1.0f, (float)(fadePosition + i) / (float)fadeLength);
+				chunk[channel][i] = outgoing[channel][i] + gain * (chunk[channel][i] - outgoing[channel][i]);
+			}
+		}
+
+		fadePosition += numChunk;
+		done += numChunk;
+	}
+
+	// the collector frees the old engine
+	if (fadePosition >= fadeLength)
+		collector->retire(fading.release());
+}
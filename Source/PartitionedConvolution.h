@@ -0,0 +1,109 @@
+/*
+  ==============================================================================
+
+    PartitionedConvolution.h
+
+    Stereo convolution with non-uniform partitions. The head of the impulse
+    response runs on the audio thread in small zero-latency partitions, the
+    tail is split into levels of growing partition size that run on a
+    background worker. Every level's result is needed two of its blocks after
+    its input arrived, so the worker always has one block period of slack; it
+    serves the level with the earliest deadline first and the audio thread
+    computes a level itself when the worker falls behind. Left and right share
+    one FFT per partition size.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+class PartitionedConvolution
+{
+public:
+	/** What a signal mixed with the convolution needs to line up with one particular response, e.g. the
+		pre-delay and gain of the network that takes over from the early part of a hybrid response. It
+		travels with the response and changes when the response takes over, not when it was loaded.
+	*/
+	struct Handover
+	{
+		int preDelay = 0;
+		float gain = 1.0f;
+		double mixingTime = 0.0;
+	};
+
+	PartitionedConvolution();
+	~PartitionedConvolution();
+
+	/** Rebuilds the partitions of the loaded impulse response for the new rate and block size.
+		Not concurrent with process(), as for AudioProcessor::prepareToPlay.
+	*/
+	void prepare(double sampleRate, int maximumBlockSize);
+	void reset();
+
+	/** Builds the partitions of a new impulse response on the calling thread, any thread but the
+		audio thread, and hands them to process() which crossfades to it from its next call. The response is
+		shared, not copied, and kept for later prepares; several engines can run channel pairs of one
+		response. Channels firstChannel and firstChannel + 1 are convolved, wrapped around, so a mono
+		response feeds both. Normalised over all its channels like juce::dsp::Convolution::Normalise::yes
+		unless told otherwise.
+	*/
+	void loadImpulseResponse(std::shared_ptr<const juce::AudioBuffer<float>> impulseResponse, double impulseResponseSampleRate,
+	                         bool normalise = true, int firstChannel = 0, Handover handover = {});
+
+	/** Lets a loaded response take over unless a crossfade is still running. process() does this itself,
+		call it before to know which response the next process() runs. Audio thread.
+	*/
+	void switchToPendingResponse() noexcept;
+
+	/** True from a load until its response runs on its own, i.e. taken over and faded in. Audio thread. */
+	bool isSwitchingResponse() const noexcept                   { return pending.load() != nullptr || fading != nullptr; }
+
+	/** The handover of the response process() runs, nullptr before the first one arrived. Audio thread. */
+	const Handover* getCurrentHandover() const noexcept;
+
+	/** Convolves both channels in place. A new response fades in over 50 ms while the one before fades out. */
+	void process(float* left, float* right, int numSamples) noexcept;
+
+	/** Length of the impulse response process() currently runs, 0 before the first one arrived. */
+	int getCurrentIRSize() const noexcept                       { return currentIRSize.load(); }
+
+	/** Off runs every level on the audio thread, e.g. to measure the total cost. Takes effect at the next load or prepare. */
+	void setUseBackgroundThread(bool shouldUseBackgroundThread) { useBackgroundThread = shouldUseBackgroundThread; }
+
+	/** Number of tail blocks the worker did not finish in time, they were computed on the audio thread. */
+	int getNumDeadlineMisses() const noexcept                   { return deadlineMisses.load(); }
+
+private:
+	class Engine;
+	class Collector;
+
+	std::unique_ptr<Engine> createEngine();
+
+	juce::CriticalSection loadLock;
+	std::shared_ptr<const juce::AudioBuffer<float>> impulseResponse;
+	int firstImpulseResponseChannel = 0;
+	double impulseResponseRate = 0.0;
+	bool normaliseImpulseResponse = true;
+	Handover impulseResponseHandover;
+	double sampleRate = 0.0;
+	int maximumBlockSize = 0;
+	bool useBackgroundThread = true;
+
+	std::unique_ptr<Engine> current;
+	std::atomic<Engine*> pending{ nullptr };
+	// the engine current replaced, still running until its fade is over
+	std::unique_ptr<Engine> fading;
+	juce::AudioBuffer<float> fadeBuffer;
+	int fadeLength = 1;
+	int fadePosition = 0;
+	std::atomic<int> currentIRSize{ 0 };
+	std::atomic<int> deadlineMisses{ 0 };
+	juce::SharedResourcePointer<Collector> collector;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PartitionedConvolution)
+};
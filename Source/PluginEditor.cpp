@@ -8,17 +8,11 @@
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "CoefficientWorkerClient.h"
 
 #include "JuceHeader.h"
 #include <filesystem>
 
-PYBIND11_EMBEDDED_MODULE(local_calc, m) {
-    // `m` is a `py::module_` which is used to bind functions and classes
-    m.def("add", [](int i, int j) {
-        return i + j;
-        });
-}
-
 //==============================================================================
 nnAudioProcessorEditor::nnAudioProcessorEditor (nnAudioProcessor& p)
     : AudioProcessorEditor (&p), audioProcessor (p)
@@ -32,6 +26,12 @@ nnAudioProcessorEditor::nnAudioProcessorEditor (nnAudioProcessor& p)
     addAndMakeVisible(btn_load_py);
     addAndMakeVisible(table);
     addAndMakeVisible(btn_convert_parameters);
+    addAndMakeVisible(progressBar);
+    addAndMakeVisible(btn_hybrid);
+    addAndMakeVisible(sld_mixing_time);
+   #if NN_PROFILING
+    addAndMakeVisible(profilerView);
+   #endif
 
     edt_py_path.setText("D:\\Project\\NN_Func\\Source");
 
@@ -44,11 +44,26 @@ nnAudioProcessorEditor::nnAudioProcessorEditor (nnAudioProcessor& p)
 	btn_convert_parameters.onClick = [this] {sync_impulse_response_n_coefficients(); };
     btn_load_rir.onClick = [this] { open_rir_chooser(); };
     btn_load_py.onClick = [this] { open_py_chooser(); };
-    setSize(800, 600);
+
+    // every change reloads the impulse response, so the slider only reports on release
+    btn_hybrid.setToggleState(audioProcessor.isHybridMode(), juce::dontSendNotification);
+    sld_mixing_time.setRange(0.0, 300.0, 1.0);
+    sld_mixing_time.setTextValueSuffix(" ms");
+    sld_mixing_time.setChangeNotificationOnlyOnRelease(true);
+    btn_hybrid.onClick = [this] { update_hybrid_mode(); };
+    sld_mixing_time.onValueChange = [this] { update_hybrid_mode(); };
+   #if NN_PROFILING
+    setSize(800, 660);
+   #else
+    setSize(800, 630);
+   #endif
 }
 
 nnAudioProcessorEditor::~nnAudioProcessorEditor()
 {
+    // the job keeps running for nothing once nobody can receive its result
+    if (decodeStatus != nullptr)
+        decodeStatus->cancelRequested = true;
 }
 
 //==============================================================================
@@ -67,75 +82,109 @@ void nnAudioProcessorEditor::init_environment()
     // edit environment path
 }
 
-void nnAudioProcessorEditor::on_decode_room_impulse_response(std::string fp, float ch1, float ch2, float ch3, float ch4)
-{    
-    auto sys = pybind11::module_::import("sys");
-    sys.attr("path").attr("insert")(0, "D:\\Project\\NN_Func\\Source");
+void nnAudioProcessorEditor::on_decode_room_impulse_response(const juce::File& file)
+{
+    const TraceRecorder::Span span("submit decode", "editor", file.getFileName());
 
-    // import module
-    auto external_module = pybind11::module_::import("external");
+    // a newer file always wins over a decode still in flight
+    if (decodeStatus != nullptr)
+        decodeStatus->cancelRequested = true;
 
-    // execute python function
-    pybind11::list pyList = external_module.attr("RIR2FDN")(fp, ch1, ch2, ch3, ch4).cast<pybind11::list>();
-    auto data = convert_pylist_to_vector_3d(pyList);
+    decodeStatus = std::make_shared<RIRDecodeJob::Status>();
 
-    // assign data to private member
-    absorption_coefs.assign(data.begin(), data.begin() + 4);
-    transition_coefs = data[4];
+    std::vector<float> delayLines(audioProcessor.delayLines.begin(), audioProcessor.delayLines.end());
+    auto callback = [safeThis = juce::Component::SafePointer<nnAudioProcessorEditor>(this), file, status = decodeStatus]
+                    (const FilterCoefficientSet& data, std::shared_ptr<const SharedImpulseResponse> rir)
+    {
+        // results of a superseded job are dropped
+        if (safeThis != nullptr && safeThis->decodeStatus == status)
+            safeThis->on_decode_finished(file, data, std::move(rir));
+    };
 
-    for (size_t channel = 0; channel < 4; channel++)
+    // the worker process keeps Python out of the host, the in-process job is the fallback
+    if (auto* worker = audioProcessor.getDesignWorker())
     {
-        for (size_t band = 0; band < 11; band++)
+        if (worker->submit(file, edt_py_path.getText(), delayLines, decodeStatus, callback))
         {
-            table.update_entry(channel+1, band+1, absorption_coefs[channel][band]);
+            startTimerHz(15);
+            return;
         }
     }
 
-    for (size_t band = 0; band < 11; band++)
-    {
-        table.update_entry(5, band+1, transition_coefs[band]);
-    }
+    // Python starts with the first decode that needs it, never when the plugin is merely instantiated
+    PythonInterpreter* python = nullptr;
+   #if NN_PYTHON
+    python = audioProcessor.python;
+    if (!RIRDecodeJob::canDecodeNatively(edt_py_path.getText()))
+        python->startIfNeeded();
+   #endif
+    audioProcessor.decodePool.addJob(new RIRDecodeJob(python, file, edt_py_path.getText(), std::move(delayLines), decodeStatus, std::move(callback)), true);
+    startTimerHz(15);
 }
 
-void nnAudioProcessorEditor::disp_coefficient()
+void nnAudioProcessorEditor::on_decode_finished(const juce::File& file, const FilterCoefficientSet& data, std::shared_ptr<const SharedImpulseResponse> rir)
 {
-    for (size_t i = 0; i < absorption_coefs.size(); ++i)
+    // assign data to private member
+    coefficients = data;
+
+    table.clean_entry();
+    for (int channel = 0; channel < delaySize; channel++)
     {
-        for (size_t j = 0; j < absorption_coefs[i].size(); ++j)
+        for (int band = 0; band < bandSize; band++)
         {
-            for (size_t k = 0; k < absorption_coefs[i][j].size(); ++k)
-            {
-                DBG("Element at index (" << i << ", " << j << ", " << k << ") = " << absorption_coefs[i][j][k]);
-            }
+            table.update_entry(channel+1, band+1, coefficients.absorption(channel, band));
         }
     }
 
-    for (size_t j = 0; j < transition_coefs.size(); ++j)
+    for (int band = 0; band < bandSize; band++)
     {
-        for (size_t k = 0; k < transition_coefs[j].size(); ++k)
-        {
-            DBG("Element at index (" << ", " << j << ", " << k << ") = " << transition_coefs[j][k]);
-        }
+        table.update_entry(delaySize+1, band+1, coefficients.transition(band));
     }
+
+    edt_rir_path.setText(file.getFullPathName());
+    disp_coefficient();
+    result = file;
+
+    auto ColourId1 = juce::Colours::darkseagreen;
+    btn_convert_parameters.setColour(0x1000100, ColourId1);
+
+    sync_impulse_response_n_coefficients(std::move(rir));
 }
 
-std::vector<std::vector<std::vector<float>>> nnAudioProcessorEditor::convert_pylist_to_vector_3d(pybind11::list pylist)
+void nnAudioProcessorEditor::timerCallback()
 {
-    std::vector<std::vector<std::vector<float>>> output_data(pylist.size());
+    if (decodeStatus == nullptr)
+    {
+        stopTimer();
+        return;
+    }
+
+    const auto state = decodeStatus->state.load();
+    decodeProgress = decodeStatus->progress.load();
+    progressBar.setTextToDisplay(RIRDecodeJob::getStateName(state));
 
-    for (size_t i = 0; i < pylist.size(); i++) 
+    if (state == RIRDecodeJob::State::done || state == RIRDecodeJob::State::failed || state == RIRDecodeJob::State::cancelled)
     {
-        output_data[i] = std::vector<std::vector<float>>(pylist[i].cast<pybind11::list>().size());
-        for (size_t j = 0; j < pylist[i].cast<pybind11::list>().size(); j++) 
+        stopTimer();
+
+        // a finished decode is written with the impulse response load that follows it, a failed one here
+        if (state != RIRDecodeJob::State::done)
+            TraceRecorder::getInstance().write();
+    }
+}
+
+void nnAudioProcessorEditor::disp_coefficient()
+{
+    for (int i = 0; i < FilterCoefficientSet::numRows; ++i)
+    {
+        for (int j = 0; j < bandSize; ++j)
         {
-            output_data[i][j] = std::vector<float>(pylist[i].cast<pybind11::list>()[j].cast<pybind11::list>().size());
-            for (size_t k = 0; k < pylist[i].cast<pybind11::list>()[j].cast<pybind11::list>().size(); k++) 
+            for (int k = 0; k < FilterCoefficientSet::sectionSize; ++k)
             {
-                output_data[i][j][k] = pylist[i].cast<pybind11::list>()[j].cast<pybind11::list>()[k].cast<float>();
+                DBG("Element at index (" << i << ", " << j << ", " << k << ") = " << coefficients.section(i, j)[k]);
             }
         }
     }
-    return output_data;
 }
 
 void nnAudioProcessorEditor::open_rir_chooser()
@@ -144,17 +193,10 @@ void nnAudioProcessorEditor::open_rir_chooser()
 	{
 		if (chooser.getResult().getFileExtension() == ".wav" || chooser.getResult().getFileExtension() == ".mp3")
 		{
-			table.clean_entry();
-			on_decode_room_impulse_response(chooser.getResult().getFullPathName().toStdString(), audioProcessor.delayLine1, audioProcessor.delayLine2, audioProcessor.delayLine3, audioProcessor.delayLine4);
-            edt_rir_path.setText(chooser.getResult().getFullPathName());
-			disp_coefficient();
-			result = chooser.getResult();
+			on_decode_room_impulse_response(chooser.getResult());
 		}	
     };
     fileChooser.launchAsync(juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles, callback);
-
-	auto ColourId1 = juce::Colours::darkseagreen;
-	btn_convert_parameters.setColour(0x1000100, ColourId1);
 }
 
 void nnAudioProcessorEditor::open_py_chooser()
@@ -168,51 +210,32 @@ void nnAudioProcessorEditor::open_py_chooser()
     fileChooser.launchAsync(juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles, callback);
 }
 
-void nnAudioProcessorEditor::sync_impulse_response_n_coefficients()
+void nnAudioProcessorEditor::sync_impulse_response_n_coefficients(std::shared_ptr<const SharedImpulseResponse> rir)
 {
 	auto ColourId1 = juce::Colours::yellowgreen;
 	btn_convert_parameters.setColour(0x1000100, ColourId1);
 
-	audioProcessor.convolution.reset();
-	audioProcessor.convolution.loadImpulseResponse(result, juce::dsp::Convolution::Stereo::yes, juce::dsp::Convolution::Trim::no, 0);
-
-	for (size_t i = 0; i < absorption_coefs.size(); ++i)
+	// handed to the audio thread in one piece, ahead of the response so a hybrid load can level match against them
+	if (coefficients.isValid())
 	{
-		for (size_t j = 0; j < absorption_coefs[i].size(); ++j)
-		{
-            auto b0 = absorption_coefs[i][j][0];
-            auto b1 = absorption_coefs[i][j][1];
-            auto b2 = absorption_coefs[i][j][2];
-
-            auto a0 = absorption_coefs[i][j][3];
-            auto a1 = absorption_coefs[i][j][4];
-            auto a2 = absorption_coefs[i][j][5];
-
-            juce::IIRCoefficients coeffs(b0, b1, b2, a0, a1, a2);
-            audioProcessor.absorptionFilters[i][j].setCoefficients(coeffs);
-		}
+		const TraceRecorder::Span span("publish coefficients", "editor");
+		audioProcessor.publishCoefficients(coefficients);
 	}
 
-	for (size_t j = 0; j < transition_coefs.size(); ++j)
-	{
-        auto b0 = transition_coefs[j][0];
-        auto b1 = transition_coefs[j][1];
-        auto b2 = transition_coefs[j][2];
-        
-        auto a0 = transition_coefs[j][3];
-        auto a1 = transition_coefs[j][4];
-        auto a2 = transition_coefs[j][5];
-
-        juce::IIRCoefficients coeffs(b0, b1, b2, a0, a1, a2);
-        audioProcessor.initialFiltersL[j].setCoefficients(coeffs);
-        audioProcessor.initialFiltersR[j].setCoefficients(coeffs);
-	}
+	// loaded and swapped in off the message thread, from the decoded samples when there are any; the editor
+	// keeps no reference, so the response lives only as long as the engines need it
+	audioProcessor.loadImpulseResponse(result, std::move(rir));
+}
+
+void nnAudioProcessorEditor::update_hybrid_mode()
+{
+    audioProcessor.setHybridMode(btn_hybrid.getToggleState(), sld_mixing_time.getValue() / 1000.0);
 }
 
 void nnAudioProcessorEditor::resized()
 {
     auto area = getLocalBounds();
-    auto topArea = area.removeFromTop(118);
+    auto topArea = area.removeFromTop(178);
 
     auto buttonArea = topArea.removeFromTop(42).reduced(5);
     //btn_load_file.setBounds(buttonArea.removeFromLeft(buttonArea.getWidth() / 2).reduced(2));
@@ -228,6 +251,16 @@ void nnAudioProcessorEditor::resized()
     edt_py_path.setBounds(pyPathArea.removeFromLeft(pyPathArea.getWidth() - 30));
     btn_load_py.setBounds(pyPathArea);
 
+    progressBar.setBounds(topArea.removeFromTop(30).reduced(5));
+
+    auto hybridArea = topArea.removeFromTop(30).reduced(5);
+    btn_hybrid.setBounds(hybridArea.removeFromLeft(240));
+    sld_mixing_time.setBounds(hybridArea);
+
+   #if NN_PROFILING
+    profilerView.setBounds(area.removeFromTop(30).reduced(5));
+   #endif
+
     table.setBounds(area);
 }
 
@@ -12,11 +12,15 @@
 #include "PluginProcessor.h"
 #include <vector>
 #include "TableListBoxTutorial.h"
+#include "RIRDecodeJob.h"
+#include "ProfilerView.h"
+#include "TraceRecorder.h"
 
 //==============================================================================
 /**
 */
-class nnAudioProcessorEditor  : public juce::AudioProcessorEditor
+class nnAudioProcessorEditor  : public juce::AudioProcessorEditor,
+                                private juce::Timer
 {
 public:
     nnAudioProcessorEditor (nnAudioProcessor&);
@@ -32,20 +36,24 @@ private:
     nnAudioProcessor& audioProcessor;
 
     void init_environment();
-    void on_decode_room_impulse_response(std::string fp, float ch1, float ch2, float ch3, float ch4);
+    void on_decode_room_impulse_response(const juce::File& file);
+    void on_decode_finished(const juce::File& file, const FilterCoefficientSet& data, std::shared_ptr<const SharedImpulseResponse> rir);
+    void timerCallback() override;
     void disp_coefficient();
-    std::vector<std::vector<std::vector<float>>> convert_pylist_to_vector_3d(pybind11::list pylist);
-    std::vector<std::vector<std::vector<float>>> absorption_coefs;
-    std::vector<std::vector<float>> transition_coefs;
+    FilterCoefficientSet coefficients;
     void open_rir_chooser();
     void open_py_chooser();
-    void sync_impulse_response_n_coefficients();
+    void sync_impulse_response_n_coefficients(std::shared_ptr<const SharedImpulseResponse> rir = nullptr);
 
     //pybind11::object external_module;
 	
     int int_decode_data;
     float ext_decode_data;
     CoefficientTableComponent table;
+
+    std::shared_ptr<RIRDecodeJob::Status> decodeStatus;
+    double decodeProgress = 0.0;
+    juce::ProgressBar progressBar{ decodeProgress };
     juce::Label lbl_rir_path;
     juce::TextEditor edt_rir_path;
 
@@ -56,6 +64,14 @@ private:
     juce::TextButton btn_load_py{ "..." };
 
     juce::TextButton btn_convert_parameters{ "Convert Parameters" };
+
+    // convolution up to the mixing time, the network after it; 0 ms estimates the mixing time from the RIR
+    juce::ToggleButton btn_hybrid{ "Hybrid (FDN after the mixing time)" };
+    juce::Slider sld_mixing_time{ juce::Slider::LinearHorizontal, juce::Slider::TextBoxRight };
+    void update_hybrid_mode();
+   #if NN_PROFILING
+    ProfilerView profilerView{ audioProcessor.profiler };
+   #endif
 	juce::File result;
     juce::FileChooser fileChooser{ "Browse for Room Imoulse Response Data", juce::File::getSpecialLocation(juce::File::invokedExecutableFile) };
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (nnAudioProcessorEditor)
@@ -8,6 +8,9 @@
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "CoefficientWorkerClient.h"
+#include "TraceRecorder.h"
+#include "SharedImpulseResponse.h"
 
 //==============================================================================
 nnAudioProcessor::nnAudioProcessor()
@@ -30,6 +33,9 @@ nnAudioProcessor::nnAudioProcessor()
 
 nnAudioProcessor::~nnAudioProcessor()
 {
+	// stop decodes while the interpreter is still alive. No timeout, the jobs use this processor, so none of them
+	// may outlive it: decodes stop at their next progress report, loads finish the engine they are building
+	decodePool.removeAllJobs(true, -1);
 }
 
 //==============================================================================
@@ -98,53 +104,134 @@ void nnAudioProcessor::changeProgramName (int index, const juce::String& newName
 void nnAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
 	// init feedback delay network
-	CB1.reset(new CircularBuffer<double>);
-	CB2.reset(new CircularBuffer<double>);
-	CB3.reset(new CircularBuffer<double>);
-	CB4.reset(new CircularBuffer<double>);
-	
-	CB1->createCircularBuffer(4096);
-	CB1->flushBuffer();
-	
-	CB2->createCircularBuffer(4096);
-	CB2->flushBuffer();
-	
-	CB3->createCircularBuffer(4096);
-	CB3->flushBuffer();
-	
-	CB4->createCircularBuffer(4096);
-	CB4->flushBuffer();
-	
-	bufferL.resize(samplesPerBlock);
-	bufferR.resize(samplesPerBlock);
-	dryL.resize(samplesPerBlock);
-	dryR.resize(samplesPerBlock);
-	
-	feedbackLoop1 = 0.0f;
-	feedbackLoop2 = 0.0f;
-	feedbackLoop3 = 0.0f;
-	feedbackLoop4 = 0.0f;
-
-	delayLine1 = 2003;
-	delayLine2 = 2011;
-	delayLine3 = 4049;
-	delayLine4 = 4051;
-
-	absorptionFilters.resize(delaySize);
-	for (auto& filter : absorptionFilters)
-	{
-		filter.resize(bandSize);
-	}
-
-	initialFiltersL.resize(bandSize);
-	initialFiltersR.resize(bandSize);
+	std::array<int, delaySize> delaysInSamples;
+	for (int line = 0; line < delaySize; line++)
+	{
+		delaysInSamples[line] = (int)delayLines[line];
+	}
+
+	fdnMaxDeviation = 0.0f;
+
+	// every channel feeds and taps a line of its own, the layout check keeps hosts within that
+	numChannels = juce::jlimit(1, juce::jmin(ChannelLayout::maxChannels, delaySize), getTotalNumOutputChannels());
+	const auto previousGroups = numChannelGroups.exchange((numChannels + 1) / 2);
+	const auto numGroups = numChannelGroups.load();
+	channelGroupPool.setNumWorkers(juce::jmin(numGroups, juce::SystemStats::getNumCpus()) - 1);
+
+	// the scratch is one sub-block long, so any host block size runs without reallocating
+	internalBlockSize = juce::jlimit(16, 4096, subBlockSize.load());
+
+	// every delay line and scratch buffer in one block, the host picks the precision before preparing
+	// and only that one gets its buffers. The float convolution copy is only needed for double hosts,
+	// and for float hosts the spare channel of an odd layout, the convolution runs in place otherwise
+	const auto numConvolutionChannels = isUsingDoublePrecision() || numChannels % 2 != 0 ? 2 * numGroups : 0;
+	arena.build([&](Arena& memory)
+	{
+		if (isUsingDoublePrecision())
+		{
+			prepareState(doubleState, memory, sampleRate);
+		}
+		else
+		{
+			prepareState(floatState, memory, sampleRate);
+		}
+
+		auto* lines = memory.take<float>((size_t)decltype(fdnCore)::getStorageSize(delaysInSamples));
+		float* convolutionChannels[ChannelLayout::maxChannels] = {};
+		for (int channel = 0; channel < numConvolutionChannels; channel++)
+		{
+			convolutionChannels[channel] = memory.take<float>((size_t)internalBlockSize);
+		}
+
+		if (!memory.isMeasuring())
+		{
+			fdnCore.prepare(delaysInSamples, lines);
+			convolutionBuffer.setDataToReferTo(convolutionChannels, numConvolutionChannels, internalBlockSize);
+		}
+	});
 
 	// init convolution
 	spec.sampleRate = sampleRate;
-	spec.maximumBlockSize = samplesPerBlock;
-	spec.numChannels = getTotalNumOutputChannels();
+	spec.maximumBlockSize = (juce::uint32)internalBlockSize;
+	spec.numChannels = (juce::uint32)juce::jmin(2, numChannels);
 	convolution.reset();
 	convolution.prepare(spec);
+	for (auto& partitionedConvolution : partitionedConvolutions)
+	{
+		partitionedConvolution.prepare(sampleRate, internalBlockSize);
+	}
+
+	// groups the last load did not fill need the response again
+	const auto file = getImpulseResponseFile();
+	if (numGroups > previousGroups && file.existsAsFile())
+	{
+		loadImpulseResponse(file);
+	}
+
+	outputStage.reset(level1->get(), level2->get(), fdnOutputGain.load() * level3->get());
+	profiler.prepare(sampleRate);
+}
+
+template <typename SampleType>
+void nnAudioProcessor::prepareState(PrecisionState<SampleType>& state, Arena& memory, double sampleRate)
+{
+	// the lines are read at the same time, so their starts are spread over the L1 sets; 4049 and 4051
+	// samples into buffers of the same length would otherwise read the same set at every sample
+	const auto lineLength = (unsigned int)juce::nextPowerOfTwo((int)*std::max_element(delayLines.begin(), delayLines.end()) + 1);
+	for (int line = 0; line < delaySize; line++)
+	{
+		auto* storage = memory.take<SampleType>(CircularBuffer<SampleType>::getStorageLength(lineLength, 8), Arena::spread(line, delaySize));
+		if (!memory.isMeasuring())
+		{
+			state.delayBuffers[line].createCircularBuffer(lineLength, 8, storage);
+		}
+	}
+
+	// one sub-block per channel and per line
+	for (int channel = 0; channel < numChannels; channel++)
+	{
+		state.dry[channel] = memory.take<SampleType>((size_t)internalBlockSize);
+		state.preDelayed[channel] = memory.take<SampleType>((size_t)internalBlockSize);
+	}
+	for (int channel = 0; channel < 2 * numChannelGroups.load(); channel++)
+	{
+		state.network[channel] = memory.take<SampleType>((size_t)internalBlockSize);
+	}
+	state.compareL = memory.take<SampleType>((size_t)internalBlockSize);
+	state.compareR = memory.take<SampleType>((size_t)internalBlockSize);
+	for (auto& line : state.feedbackBlocks)
+	{
+		line = memory.take<SampleType>((size_t)internalBlockSize);
+	}
+
+	// the hybrid pre-delay is at most a second, read one sub-block behind the write
+	const auto preDelayLength = (unsigned int)juce::nextPowerOfTwo((int)sampleRate + internalBlockSize + 1);
+	for (int channel = 0; channel < numChannels; channel++)
+	{
+		auto* storage = memory.take<SampleType>(CircularBuffer<SampleType>::getStorageLength(preDelayLength), Arena::spread(channel, numChannels));
+		if (!memory.isMeasuring())
+		{
+			state.preDelayBuffers[channel].createCircularBuffer(preDelayLength, 0, storage);
+		}
+	}
+
+	state.absorptionFilters.reset();
+	for (auto& transitionFilters : state.transitionFilters)
+	{
+		transitionFilters.reset();
+	}
+}
+
+template <>
+nnAudioProcessor::PrecisionState<float>& nnAudioProcessor::getState<float>() noexcept
+{
+	return floatState;
+}
+
+template <>
+nnAudioProcessor::PrecisionState<double>& nnAudioProcessor::getState<double>() noexcept
+{
+	return doubleState;
 }
 
 void nnAudioProcessor::releaseResources()
@@ -160,12 +247,11 @@ bool nnAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) const
     juce::ignoreUnused (layouts);
     return true;
   #else
-    // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
-    // Some plugin hosts, such as certain GarageBand versions, will only
-    // load plugins that support stereo bus layouts.
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+    // Mono, stereo and any wider layout, e.g. 7.1.4 in the Multichannel build,
+    // as long as every channel gets a delay line of its own. Some plugin hosts, such as certain
+    // GarageBand versions, will only load plugins that support stereo bus layouts.
+    const auto size = layouts.getMainOutputChannelSet().size();
+    if (layouts.getMainOutputChannelSet().isDisabled() || size > juce::jmin(ChannelLayout::maxChannels, delaySize))
         return false;
 
     // This checks if the input layout matches the output layout
@@ -179,63 +265,600 @@ bool nnAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) const
 }
 #endif
 
+bool nnAudioProcessor::supportsDoublePrecisionProcessing() const
+{
+	return true;
+}
+
 void nnAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+	process(buffer);
+}
+
+void nnAudioProcessor::processBlock (juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages)
+{
+	process(buffer);
+}
+
+template <typename SampleType>
+void nnAudioProcessor::process(juce::AudioBuffer<SampleType>& buffer)
 {
 	juce::ScopedNoDenormals noDenormals;
 
-	auto blockSize = buffer.getNumSamples();
+	profiler.beginBlock();
+	applyPendingCoefficients();
+	applyPendingResponse();
+
+	// the parameters are read once per host block, every sub-block ends on its share of the ramp
+	const auto numSamples = buffer.getNumSamples();
+	const float targets[] = { level1->get(), level2->get(), fdnOutputGain.load() * level3->get() };
+	float starts[OutputStage::numGains];
+	for (int gain = 0; gain < OutputStage::numGains; gain++)
+	{
+		starts[gain] = outputStage.getGain(gain);
+	}
+
+	for (int start = 0; start < numSamples; start += internalBlockSize)
+	{
+		const auto subBlock = juce::jmin(internalBlockSize, numSamples - start);
+		const auto position = (float)(start + subBlock) / (float)numSamples;
+		processSubBlock(buffer, start, subBlock,
+		                starts[OutputStage::dry] + position * (targets[OutputStage::dry] - starts[OutputStage::dry]),
+		                starts[OutputStage::convolution] + position * (targets[OutputStage::convolution] - starts[OutputStage::convolution]),
+		                starts[OutputStage::network] + position * (targets[OutputStage::network] - starts[OutputStage::network]));
+	}
+
+	profiler.endBlock(numSamples);
+}
+
+template <typename SampleType>
+void nnAudioProcessor::processSubBlock(juce::AudioBuffer<SampleType>& buffer, int start, int blockSize, float dryGain, float convolutionGain, float networkGain)
+{
+	auto& state = getState<SampleType>();
+	auto stageStart = profiler.start();
+
+	// channels beyond the prepared layout pass through dry
+	const auto channels = juce::jmin(numChannels, buffer.getNumChannels());
+	const auto numGroups = (channels + 1) / 2;
+	const auto preDelay = fdnPreDelay.load();
+
+	// store dry signal, in hybrid mode the network hears the input late enough to answer at the mixing time
+	const SampleType* dryChannels[ChannelLayout::maxChannels];
+	const SampleType* fdnInputs[ChannelLayout::maxChannels];
+	for (int channel = 0; channel < channels; channel++)
+	{
+		auto* dry = state.dry[channel];
+		juce::FloatVectorOperations::copy(dry, buffer.getReadPointer(channel, start), blockSize);
+		dryChannels[channel] = dry;
+		fdnInputs[channel] = dry;
+
+		state.preDelayBuffers[channel].writeBlock(dry, blockSize);
+		if (preDelay > 0)
+		{
+			state.preDelayBuffers[channel].readBlock(preDelay + blockSize, state.preDelayed[channel], blockSize);
+			fdnInputs[channel] = state.preDelayed[channel];
+		}
+	}
+
+	stageStart = profiler.lap(StageProfiler::dry, stageStart);
+
+	SampleType* networkChannels[ChannelLayout::maxChannels];
+	for (int channel = 0; channel < 2 * numGroups; channel++)
+	{
+		networkChannels[channel] = state.network[channel];
+	}
+
+	// feedback delay network Process, the bank loop is the reference for the vectorised core
+	if (channels != 2)
+	{
+		// one decorrelated tap per channel, the spare channel of an odd layout stays silent
+		fdnCore.process(fdnInputs, networkChannels, channels, blockSize);
+		if (channels % 2 != 0)
+		{
+			juce::FloatVectorOperations::clear(networkChannels[channels], blockSize);
+		}
+	}
+	else if (fdnProcessing != FDNProcessing::vectorised)
+	{
+		// every delay is longer than a chunk, so a chunk can be read from the lines before it is written back
+		const int chunkSize = (int)*std::min_element(delayLines.begin(), delayLines.end());
+		const auto matrixGain = (SampleType)decltype(fdnCore)::getMatrixGain();
+		const auto tapGain = (SampleType)decltype(fdnCore)::getTapGain();
+
+		for (int chunkStart = 0; chunkStart < blockSize; chunkStart += chunkSize)
+		{
+			const int numSamples = juce::jmin(chunkSize, blockSize - chunkStart);
+
+			for (int line = 0; line < delaySize; line++)
+			{
+				state.delayBuffers[line].readBlock((int)delayLines[line], state.feedbackBlocks[line], numSamples);
+			}
+
+			for (int i = 0; i < numSamples; i++)
+			{
+				// band k of all lines in one vector operation
+				SampleType lines[delaySize];
+				for (int line = 0; line < delaySize; line++)
+				{
+					lines[line] = state.feedbackBlocks[line][i];
+				}
+				state.absorptionFilters.processSample(lines);
+
+				SampleType tapL = 0;
+				SampleType tapR = 0;
+				for (int line = 0; line < delaySize; line++)
+				{
+					(decltype(fdnCore)::feedsLeftTap(line) ? tapL : tapR) += lines[line];
+				}
+
+				// Hadamard feedback matrix, N log N instead of N^2
+				fastWalshHadamard(lines, delaySize);
+				for (int line = 0; line < delaySize; line++)
+				{
+					state.feedbackBlocks[line][i] = matrixGain * lines[line];
+				}
+				state.feedbackBlocks[0][i] += fdnInputs[0][chunkStart + i];
+				state.feedbackBlocks[1][i] += fdnInputs[1][chunkStart + i];
+
+				networkChannels[0][chunkStart + i] = tapGain * tapL;
+				networkChannels[1][chunkStart + i] = tapGain * tapR;
+			}
+
+			for (int line = 0; line < delaySize; line++)
+			{
+				state.delayBuffers[line].writeBlock(state.feedbackBlocks[line], numSamples);
+			}
+		}
+	}
+
+	if (channels == 2 && fdnProcessing == FDNProcessing::vectorised)
+	{
+		fdnCore.process(fdnInputs[0], fdnInputs[1], networkChannels[0], networkChannels[1], blockSize);
+	}
+	else if (channels == 2 && fdnProcessing == FDNProcessing::compare)
+	{
+		fdnCore.process(fdnInputs[0], fdnInputs[1], state.compareL, state.compareR, blockSize);
+
+		auto deviation = fdnMaxDeviation.load();
+		for (int i = 0; i < blockSize; i++)
+		{
+			deviation = juce::jmax(deviation, (float)std::abs(networkChannels[0][i] - state.compareL[i]), (float)std::abs(networkChannels[1][i] - state.compareR[i]));
+		}
+		fdnMaxDeviation = deviation;
+	}
+	stageStart = profiler.lap(StageProfiler::network, stageStart);
+
+	// convolution input, the host buffer itself for float, a float copy for double
+	float* convolutionChannels[ChannelLayout::maxChannels];
+	for (int channel = 0; channel < 2 * numGroups; channel++)
+	{
+		if constexpr (std::is_same_v<SampleType, float>)
+		{
+			convolutionChannels[channel] = channel < channels ? buffer.getWritePointer(channel, start) : convolutionBuffer.getWritePointer(channel);
+		}
+		else
+		{
+			convolutionChannels[channel] = convolutionBuffer.getWritePointer(channel);
+			if (channel < channels)
+			{
+				juce::FloatVectorOperations::convertDoubleToFloat(convolutionChannels[channel], buffer.getReadPointer(channel, start), blockSize);
+			}
+		}
+	}
+	if (channels % 2 != 0)
+	{
+		juce::FloatVectorOperations::clear(convolutionChannels[channels], blockSize);
+	}
+
+	// the groups share nothing but the read-only inputs, so they run in parallel. Transition filters are
+	// outside the feedback loop, so they can run a whole block per band
+	auto processGroup = [&](int group)
+	{
+		SampleType* transitionChannels[] = { networkChannels[2 * group], networkChannels[2 * group + 1] };
+		state.transitionFilters[group].processBlock(transitionChannels, blockSize);
+
+		if (group == 0 && convolutionProcessing == ConvolutionProcessing::juce)
+		{
+			juce::dsp::AudioBlock<float> block(convolutionChannels, (size_t)juce::jmin(2, channels), (size_t)blockSize);
+			convolution.process(juce::dsp::ProcessContextReplacing<float>(block));
+		}
+		else
+		{
+			partitionedConvolutions[group].process(convolutionChannels[2 * group], convolutionChannels[2 * group + 1], blockSize);
+		}
+	};
+	channelGroupPool.parallelFor(numGroups, processGroup);
+	stageStart = profiler.lap(StageProfiler::channelGroups, stageStart);
+
+	// output, one fused pass with the parameters read once and ramped over the block
+	const float* convolutionOutputs[ChannelLayout::maxChannels];
+	const SampleType* networkOutputs[ChannelLayout::maxChannels];
+	SampleType* outputChannels[ChannelLayout::maxChannels];
+	for (int channel = 0; channel < channels; channel++)
+	{
+		convolutionOutputs[channel] = convolutionChannels[channel];
+		networkOutputs[channel] = networkChannels[channel];
+		outputChannels[channel] = buffer.getWritePointer(channel, start);
+	}
+	outputStage.process(dryChannels, convolutionOutputs, networkOutputs, outputChannels, channels, blockSize,
+	                    dryGain, convolutionGain, networkGain);
+	profiler.lap(StageProfiler::mix, stageStart);
+}
+
+CoefficientWorkerClient* nnAudioProcessor::getDesignWorker()
+{
+	JUCE_ASSERT_MESSAGE_THREAD
+
+	// one worker process per instance, so decodes of different instances run in parallel
+	if (designWorker == nullptr)
+	{
+		auto executable = CoefficientWorkerClient::getDefaultExecutable();
+		if (executable.existsAsFile())
+		{
+			designWorker = std::make_unique<CoefficientWorkerClient>(executable);
+		}
+	}
+	return designWorker.get();
+}
+
+void nnAudioProcessor::publishCoefficients(const FilterCoefficientSet& coefficients)
+{
+	coefficientExchange.getWriteBuffer() = coefficients;
+	coefficientExchange.publish();
+
+	// kept for the level match of the next hybrid load
+	const juce::ScopedLock sl(loadSettingsLock);
+	publishedCoefficients = coefficients;
+}
+
+template <typename SampleType>
+void nnAudioProcessor::stepCoefficientRamps(PrecisionState<SampleType>& state) noexcept
+{
+	state.absorptionFilters.stepRamp();
+	for (auto& transitionFilters : state.transitionFilters)
+	{
+		transitionFilters.stepRamp();
+	}
+}
+
+template <typename SampleType>
+void nnAudioProcessor::stageCoefficients(PrecisionState<SampleType>& state, const FilterCoefficientSet& coefficients, int rampBlocks)
+{
+	for (int line = 0; line < delaySize; line++)
+	{
+		for (int band = 0; band < bandSize; band++)
+		{
+			const auto* c = coefficients.absorption(line, band);
+			state.absorptionFilters.setTargetCoefficients(line, band, c[0], c[1], c[2], c[3], c[4], c[5]);
+		}
+	}
+
+	// every channel shares the one transition cascade
+	for (auto& transitionFilters : state.transitionFilters)
+	{
+		for (int band = 0; band < bandSize; band++)
+		{
+			const auto* c = coefficients.transition(band);
+			transitionFilters.setTargetCoefficients(0, band, c[0], c[1], c[2], c[3], c[4], c[5]);
+			transitionFilters.setTargetCoefficients(1, band, c[0], c[1], c[2], c[3], c[4], c[5]);
+		}
+	}
+
+	// filter states are kept, only the coefficients move
+	state.absorptionFilters.rampToTargets(rampBlocks);
+	for (auto& transitionFilters : state.transitionFilters)
+	{
+		transitionFilters.rampToTargets(rampBlocks);
+	}
+}
+
+void nnAudioProcessor::applyPendingCoefficients()
+{
+	// ramps already in flight keep moving towards their targets, in both precisions so a switch finds the idle one current
+	stepCoefficientRamps(floatState);
+	stepCoefficientRamps(doubleState);
+	fdnCore.stepRamp();
+
+	if (!coefficientExchange.acquire())
+	{
+		return;
+	}
+
+	const auto& coefficients = coefficientExchange.getReadBuffer();
+	const auto rampBlocks = coefficientRampBlocks.load();
+
+	for (int line = 0; line < delaySize; line++)
+	{
+		for (int band = 0; band < bandSize; band++)
+		{
+			const auto* c = coefficients.absorption(line, band);
+			fdnCore.setTargetCoefficients(line, band, juce::IIRCoefficients(c[0], c[1], c[2], c[3], c[4], c[5]));
+		}
+	}
+	fdnCore.rampToTargets(rampBlocks);
+
+	stageCoefficients(floatState, coefficients, rampBlocks);
+	stageCoefficients(doubleState, coefficients, rampBlocks);
+}
+
+void nnAudioProcessor::applyPendingResponse() noexcept
+{
+	// the network's pre-delay and gain were matched to one response, so they change in the block that response
+	// takes over in, not when the load worked them out. Every group carries the same handover
+	const auto numGroups = numChannelGroups.load();
+	for (int group = 0; group < numGroups; group++)
+	{
+		partitionedConvolutions[group].switchToPendingResponse();
+	}
+
+	if (const auto* handover = partitionedConvolutions[0].getCurrentHandover())
+	{
+		fdnPreDelay = handover->preDelay;
+		fdnOutputGain = handover->gain;
+		hybridMixingTime = handover->mixingTime;
+	}
+}
 
-	auto* inputL  = buffer.getReadPointer(0);
-	auto* inputR  = buffer.getReadPointer(1);
-	auto* outputL = buffer.getWritePointer(0);
-	auto* outputR = buffer.getWritePointer(1);
-	
-	// store dry signal
-	for (int i = 0; i < blockSize; i++)
+void nnAudioProcessor::loadImpulseResponse(const juce::File& file, std::shared_ptr<const SharedImpulseResponse> decoded)
+{
+	// the job sees the settings of this call, whatever the calling threads change while it runs
+	LoadSettings settings;
 	{
-		dryL[i] = inputL[i];
-		dryR[i] = inputR[i];
+		const juce::ScopedLock sl(loadSettingsLock);
+		impulseResponseFile = file;
+		settings.hybrid = hybridMode;
+		settings.mixingTime = userMixingTime;
+		settings.coefficients = publishedCoefficients;
 	}
+	settings.sampleRate = getSampleRate();
+	settings.numGroups = numChannelGroups.load();
 
-	// feedback delay network Process
-	for (int i = 0; i < blockSize; i++)
+	// read, split and loaded off the message thread, the engines build their partitions where they are called from
+	decodePool.addJob([this, file, decoded = std::move(decoded), settings]
 	{
-		feedbackLoop1 = CB1->readBuffer(delayLine1, false);
-		feedbackLoop2 = CB2->readBuffer(delayLine2, false);
-		feedbackLoop3 = CB3->readBuffer(delayLine3, false);
-		feedbackLoop4 = CB4->readBuffer(delayLine4, false);
+		{
+			const TraceRecorder::Span loadSpan("load impulse response", "convolution", file.getFileName());
+
+			// a decode right before this load hands its samples over, otherwise the file is read here
+			auto shared = decoded;
+			if (shared == nullptr)
+			{
+				const auto readStart = TraceRecorder::now();
+				shared = SharedImpulseResponse::load(file, ChannelLayout::maxChannels);
+				if (shared == nullptr)
+				{
+					return;
+				}
+				TraceRecorder::getInstance().addSpan("read impulse response", "convolution", readStart, file.getFullPathName());
+			}
+
+			// the decoded samples themselves, the partitioned engines keep them alive rather than a copy
+			const std::shared_ptr<const juce::AudioBuffer<float>> impulseResponse(shared, &shared->getSamples());
+			const auto impulseResponseRate = shared->getSampleRate();
+
+			if (settings.hybrid)
+			{
+				loadHybridImpulseResponse(*impulseResponse, impulseResponseRate, settings);
+			}
+			else
+			{
+				// juce::dsp::Convolution takes its response by value, the one copy of this path
+				const auto stereo = impulseResponse->getNumChannels() > 1 ? juce::dsp::Convolution::Stereo::yes : juce::dsp::Convolution::Stereo::no;
+				convolution.loadImpulseResponse(juce::AudioBuffer<float>(*impulseResponse), impulseResponseRate, stereo,
+				                                juce::dsp::Convolution::Trim::no, juce::dsp::Convolution::Normalise::yes);
+				loadChannelGroups(impulseResponse, impulseResponseRate, true, { 0, 3.0f, 0.0 }, settings);
+			}
+		}
+
+		// the last step of a load, so the trace ends with it
+		TraceRecorder::getInstance().write();
+	});
+}
 
-		auto A = processSignalThroughFilters(feedbackLoop1, absorptionFilters[0]);
-		auto B = processSignalThroughFilters(feedbackLoop2, absorptionFilters[1]);
-		auto C = processSignalThroughFilters(feedbackLoop3, absorptionFilters[2]);
-		auto D = processSignalThroughFilters(feedbackLoop4, absorptionFilters[3]);
+void nnAudioProcessor::setHybridMode(bool shouldBeHybrid, double mixingTimeSeconds)
+{
+	juce::File file;
+	{
+		const juce::ScopedLock sl(loadSettingsLock);
+		hybridMode = shouldBeHybrid;
+		userMixingTime = juce::jmax(0.0, mixingTimeSeconds);
+		file = impulseResponseFile;
+	}
 
-		auto output_1 = 0.5f * (A + B + C + D);
-		auto output_2 = 0.5f * (A - B + C - D);
-		auto output_3 = 0.5f * (A + B - C - D);
-		auto output_4 = 0.5f * (A - B - C + D);
+	if (file.existsAsFile())
+	{
+		loadImpulseResponse(file);
+	}
+}
 
-		CB1->writeBuffer(dryL[i] + output_1);
-		CB2->writeBuffer(dryR[i] + output_2);
-		CB3->writeBuffer(output_3);
-		CB4->writeBuffer(output_4);
+bool nnAudioProcessor::isHybridMode() const
+{
+	const juce::ScopedLock sl(loadSettingsLock);
+	return hybridMode;
+}
 
-		bufferL[i] = processSignalThroughFilters(A + D, initialFiltersL);
-		bufferR[i] = processSignalThroughFilters(B + C, initialFiltersL);
+juce::File nnAudioProcessor::getImpulseResponseFile() const
+{
+	const juce::ScopedLock sl(loadSettingsLock);
+	return impulseResponseFile;
+}
+
+void nnAudioProcessor::loadHybridImpulseResponse(const juce::AudioBuffer<float>& response, double impulseResponseRate, const LoadSettings& settings)
+{
+	const TraceRecorder::Span span("hybrid split", "convolution");
+	const auto sampleRate = settings.sampleRate > 0.0 ? settings.sampleRate : impulseResponseRate;
+	const auto& coefficients = settings.coefficients;
+	auto mixingTime = settings.mixingTime;
+
+	// normalised as a whole, so the early part keeps the level it has in the full response
+	const auto normalisation = HybridSplit::getNormalisationGain(response, impulseResponseRate, sampleRate);
+
+	if (mixingTime <= 0.0)
+	{
+		mixingTime = HybridSplit::estimateMixingTime(response, impulseResponseRate);
 	}
 
-	// convolution process
-	juce::dsp::AudioBlock<float> block{ buffer };
-	convolution.process(juce::dsp::ProcessContextReplacing<float>(block));
-	auto* convL = block.getChannelPointer(0);
-	auto* convR = block.getChannelPointer(1);
+	// the network answers one shortest line after its input at the earliest and is built up after its longest line,
+	// which is where the convolution has faded out
+	const auto shortestLine = (int)*std::min_element(delayLines.begin(), delayLines.end());
+	const auto longestLine = (int)*std::max_element(delayLines.begin(), delayLines.end());
+	const auto preDelay = juce::jlimit(0, (int)sampleRate, juce::roundToInt(mixingTime * sampleRate) - shortestLine);
+	mixingTime = (preDelay + shortestLine) / sampleRate;
+	const auto crossfade = longestLine / sampleRate;
+
+	// both levels are compared over 100 ms right after the crossfade, the network without its pre-delay
+	const auto matchLength = 0.1;
+	const auto responsePower = normalisation * normalisation
+	                         * HybridSplit::getMeanPower(response, juce::roundToInt((mixingTime + crossfade) * impulseResponseRate),
+	                                                     juce::roundToInt(matchLength * impulseResponseRate));
+
+	auto gain = 3.0f;
+	if (coefficients.isValid())
+	{
+		const auto matchSamples = juce::roundToInt(matchLength * sampleRate);
+		const auto networkResponse = renderNetworkResponse(coefficients, shortestLine + longestLine + matchSamples);
+		const auto networkPower = HybridSplit::getMeanPower(networkResponse, shortestLine + longestLine, matchSamples);
+		gain = networkPower > 0.0 ? (float)std::sqrt(responsePower / networkPower) : 0.0f;
+	}
 
-	// output
-	for (int i = 0; i < block.getNumSamples(); i++)
+	// only the part up to the end of the crossfade is copied, normalised on the way
+	const auto fadeStart = juce::roundToInt(mixingTime * impulseResponseRate);
+	const auto fadeLength = juce::roundToInt(crossfade * impulseResponseRate);
+	const auto earlyLength = juce::jlimit(1, response.getNumSamples(), fadeStart + fadeLength);
+	auto impulseResponse = std::make_shared<juce::AudioBuffer<float>>(response.getNumChannels(), earlyLength);
+	for (int channel = 0; channel < response.getNumChannels(); channel++)
 	{
-		outputL[i] = dryL[i] * level1->get() + convL[i] * level2->get() + bufferL[i] * 3.0f * level3->get();
-		outputR[i] = dryR[i] * level1->get() + convR[i] * level2->get() + bufferR[i] * 3.0f * level3->get();
-	}	
+		juce::FloatVectorOperations::copyWithMultiply(impulseResponse->getWritePointer(channel), response.getReadPointer(channel), normalisation, earlyLength);
+	}
+	HybridSplit::truncate(*impulseResponse, fadeStart, fadeLength);
+
+	const auto stereo = impulseResponse->getNumChannels() > 1 ? juce::dsp::Convolution::Stereo::yes : juce::dsp::Convolution::Stereo::no;
+	convolution.loadImpulseResponse(juce::AudioBuffer<float>(*impulseResponse), impulseResponseRate, stereo,
+	                                juce::dsp::Convolution::Trim::no, juce::dsp::Convolution::Normalise::no);
+	loadChannelGroups(std::move(impulseResponse), impulseResponseRate, false, { preDelay, gain, mixingTime }, settings);
+}
+
+void nnAudioProcessor::loadChannelGroups(std::shared_ptr<const juce::AudioBuffer<float>> impulseResponse, double impulseResponseRate, bool normalise,
+                                         const PartitionedConvolution::Handover& handover, const LoadSettings& settings)
+{
+	const TraceRecorder::Span span("load channel groups", "convolution");
+
+	// every group shares the one response and runs its own pair of it, normalised as a whole,
+	// so the groups keep the levels they have relative to each other
+	for (int group = 0; group < settings.numGroups; group++)
+	{
+		partitionedConvolutions[group].loadImpulseResponse(impulseResponse, impulseResponseRate, normalise, 2 * group, handover);
+	}
+}
+
+juce::AudioBuffer<float> nnAudioProcessor::renderNetworkResponse(const FilterCoefficientSet& coefficients, int numSamples) const
+{
+	// a private copy of the network and its transition filters, excited on both inputs like a centred source
+	auto network = std::make_unique<FDNCore<delaySize, bandSize>>();
+	auto transition = std::make_unique<BiquadBank<double, 2, bandSize>>();
+
+	std::array<int, delaySize> delaysInSamples;
+	for (int line = 0; line < delaySize; line++)
+	{
+		delaysInSamples[line] = (int)delayLines[line];
+	}
+	network->prepare(delaysInSamples);
+
+	for (int line = 0; line < delaySize; line++)
+	{
+		for (int band = 0; band < bandSize; band++)
+		{
+			const auto* c = coefficients.absorption(line, band);
+			network->setCoefficients(line, band, juce::IIRCoefficients(c[0], c[1], c[2], c[3], c[4], c[5]));
+		}
+	}
+	for (int band = 0; band < bandSize; band++)
+	{
+		const auto* c = coefficients.transition(band);
+		transition->setCoefficients(0, band, c[0], c[1], c[2], c[3], c[4], c[5]);
+		transition->setCoefficients(1, band, c[0], c[1], c[2], c[3], c[4], c[5]);
+	}
+
+	std::vector<double> impulse((size_t)numSamples, 0.0);
+	std::vector<double> left((size_t)numSamples), right((size_t)numSamples);
+	impulse[0] = 1.0;
+	network->process(impulse.data(), impulse.data(), left.data(), right.data(), numSamples);
+
+	double* channels[] = { left.data(), right.data() };
+	transition->processBlock(channels, numSamples);
+
+	juce::AudioBuffer<float> response(2, numSamples);
+	for (int i = 0; i < numSamples; i++)
+	{
+		response.setSample(0, i, (float)left[(size_t)i]);
+		response.setSample(1, i, (float)right[(size_t)i]);
+	}
+	return response;
+}
+
+int nnAudioProcessor::getCurrentIRSize() const
+{
+	if (convolutionProcessing == ConvolutionProcessing::partitioned)
+	{
+		return partitionedConvolutions[0].getCurrentIRSize();
+	}
+	return convolution.getCurrentIRSize();
+}
+
+bool nnAudioProcessor::isLoadingImpulseResponse() const
+{
+	// the job count first, a job only leaves the pool after it handed its engines over
+	if (decodePool.getNumJobs() > 0)
+	{
+		return true;
+	}
+
+	const auto numGroups = numChannelGroups.load();
+	for (int group = 0; group < numGroups; group++)
+	{
+		if (partitionedConvolutions[group].isSwitchingResponse())
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+std::array<float, delaySize> nnAudioProcessor::makeDelayLines()
+{
+	std::array<float, delaySize> lengths{};
+
+	// the original four lines
+	if (delaySize == 4)
+	{
+		const float original[] = { 2003, 2011, 4049, 4051 };
+		std::copy(std::begin(original), std::end(original), lengths.begin());
+		return lengths;
+	}
+
+	// larger networks spread distinct primes geometrically over the same range, so no two lines share a factor
+	auto isPrime = [](int n)
+	{
+		for (int d = 2; d * d <= n; d++)
+		{
+			if (n % d == 0)
+				return false;
+		}
+		return n > 1;
+	};
+
+	int previous = 0;
+	for (int line = 0; line < delaySize; line++)
+	{
+		auto length = juce::jmax(previous + 1, juce::roundToInt(2003.0 * std::pow(4051.0 / 2003.0, line / (double)(delaySize - 1))));
+		while (!isPrime(length))
+		{
+			length++;
+		}
+		lengths[line] = (float)length;
+		previous = length;
+	}
+	return lengths;
 }
 
 //==============================================================================
@@ -269,12 +892,3 @@ juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
 {
     return new nnAudioProcessor();
 }
-
-float nnAudioProcessor::processSignalThroughFilters(float xn, std::vector<juce::IIRFilter>& filters)
-{
-	for (auto& filter : filters) 
-	{
-		xn = filter.processSingleSampleRaw(xn);
-	}
-	return xn;
-}
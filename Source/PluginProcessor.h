@@ -9,14 +9,23 @@
 #pragma once
 
 #include <JuceHeader.h>
-#include <pybind11/embed.h>
-#include <pybind11/pybind11.h>
-#include <pybind11/stl.h>
 #include "CircularBuffer.h"
-#define delaySize 4
-#define bandSize 11
+#include "FDNCore.h"
+#include "BiquadBank.h"
+#include "TripleBuffer.h"
+#include "CoefficientTensor.h"
+#include "PartitionedConvolution.h"
+#include "HybridSplit.h"
+#include "OutputStage.h"
+#include "RealtimeWorkerPool.h"
+#include "Arena.h"
+#include "StageProfiler.h"
+#include "PythonInterpreter.h"
 #define M_PI    3.141592653589793238462643383279502884 
 
+class CoefficientWorkerClient;
+class SharedImpulseResponse;
+
 //==============================================================================
 /**
 */
@@ -38,7 +47,14 @@ public:
     bool isBusesLayoutSupported (const BusesLayout& layouts) const override;
    #endif
 
+    // both precisions run the same template at host precision, only the convolution engines are float only.
+    // float keeps every buffer in float and converts nothing; double converts the input to float for the
+    // convolution and its result back inside the output stage, two passes per block instead of one per stage.
+    // The reference FDN loop is latency bound and about 15% cheaper in float, the vectorised core is float
+    // internally either way, see the fdn and mix stages of NN_Benchmark for both precisions.
+    bool supportsDoublePrecisionProcessing() const override;
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void processBlock (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
 
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
@@ -63,39 +79,166 @@ public:
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
 
-    pybind11::scoped_interpreter guard;
-
-	std::unique_ptr<CircularBuffer<double>> CB1;
-	std::unique_ptr<CircularBuffer<double>> CB2;
-	std::unique_ptr<CircularBuffer<double>> CB3;
-	std::unique_ptr<CircularBuffer<double>> CB4;
-
-    std::vector<double> bufferL;
-    std::vector<double> bufferR;
-    std::vector<double> dryL;
-    std::vector<double> dryR;
-
-	double feedbackLoop1;
-	double feedbackLoop2;
-	double feedbackLoop3;
-	double feedbackLoop4;
-
-	std::vector<std::vector<juce::IIRFilter>> absorptionFilters;
-
-	std::vector<juce::IIRFilter> initialFiltersL;
-	std::vector<juce::IIRFilter> initialFiltersR;
-
-	float delayLine1;
-	float delayLine2;
-	float delayLine3;
-	float delayLine4;
+    // message thread only, the audio thread picks the set up at the next block boundary
+    void publishCoefficients(const FilterCoefficientSet& coefficients);
+    // number of blocks new coefficients are ramped over, 0 switches at the block boundary
+    std::atomic<int> coefficientRampBlocks{ 8 };
+    // every host block runs through the whole chain in blocks of at most this many samples, so the scratch
+    // of each stage stays in L1 whatever the host sends. Takes effect at the next prepareToPlay.
+    // 64 is the smallest the convolution head takes without transforming a block twice; the sub_blocks
+    // stage of NN_Benchmark has the stereo time-domain chain at 152 ns/sample there against 177 for one
+    // 4096 sample pass (48 KiB L1), mostly from the transition passes overlapping once they fit the core.
+    std::atomic<int> subBlockSize{ 64 };
+
+   #if NN_PYTHON
+    // shared by all instances and only started by the first decode
+    juce::SharedResourcePointer<PythonInterpreter> python;
+   #endif
+    // declared after the interpreter so running decodes are finished before it shuts down
+    juce::ThreadPool decodePool{ 1 };
+    // out-of-process designer, nullptr when no NN_Worker sits next to the plugin
+    CoefficientWorkerClient* getDesignWorker();
+
+	// layouts run in pairs of channels, each pair with its own transition filters and convolution engine
+	static constexpr int maxChannelGroups = ChannelLayout::maxChannels / 2;
+
+	//==============================================================================
+	/** Everything processBlock keeps at host precision. Only the precision the host
+		chose before prepareToPlay gets its buffers, carved from the arena, scratch one sub-block long.
+	*/
+	template <typename SampleType>
+	struct PrecisionState
+	{
+		std::array<CircularBuffer<SampleType>, delaySize> delayBuffers;
+
+		// per channel, the network has a spare channel when an odd layout leaves the last group half full
+		std::array<SampleType*, ChannelLayout::maxChannels> dry{};
+		std::array<SampleType*, ChannelLayout::maxChannels> network{};
+		SampleType* compareL = nullptr;
+		SampleType* compareR = nullptr;
+
+		// per line scratch for block-at-a-time delay reads and writes
+		std::array<SampleType*, delaySize> feedbackBlocks{};
+
+		BiquadBank<SampleType, delaySize, bandSize> absorptionFilters;
+
+		// one bank per channel group, lane 0 is the even channel, lane 1 the odd one
+		std::array<BiquadBank<SampleType, 2, bandSize>, maxChannelGroups> transitionFilters;
+
+		// hybrid mode pre-delay of the network input, per channel
+		std::array<CircularBuffer<SampleType>, ChannelLayout::maxChannels> preDelayBuffers;
+		std::array<SampleType*, ChannelLayout::maxChannels> preDelayed{};
+	};
+	PrecisionState<float> floatState;
+	PrecisionState<double> doubleState;
+
+	// the bank path is kept as the reference implementation, compare runs both and tracks the deviation.
+	// Both are stereo only, every other layout runs the vectorised core with one tap per channel.
+	enum class FDNProcessing { reference, vectorised, compare };
+	FDNProcessing fdnProcessing = FDNProcessing::vectorised;
+	FDNCore<delaySize, bandSize> fdnCore;
+	std::atomic<float> fdnMaxDeviation{ 0.0f };
+
+	// line lengths in samples, mutually prime, the same for every instance. Tools that only need the lengths,
+	// e.g. for the coefficient analysis, call it without constructing a processor
+	static std::array<float, delaySize> makeDelayLines();
+	// fixed from construction on so the editor and the background loads can read them before the first prepareToPlay
+	const std::array<float, delaySize> delayLines = makeDelayLines();
 
 	juce::AudioParameterFloat* level1;
 	juce::AudioParameterFloat* level2;
 	juce::AudioParameterFloat* level3;
 	juce::dsp::Convolution convolution;
 	juce::dsp::ProcessSpec spec;
+
+	// the partitioned engine keeps only the head on the audio thread, juce::dsp::Convolution is kept for comparison
+	// and only runs the first pair of channels
+	enum class ConvolutionProcessing { juce, partitioned };
+	ConvolutionProcessing convolutionProcessing = ConvolutionProcessing::partitioned;
+	// one stereo engine per channel group, group g convolves with channels 2g and 2g + 1 of the response,
+	// wrapped around when it has fewer, so a stereo response serves every pair of a larger layout
+	std::array<PartitionedConvolution, maxChannelGroups> partitionedConvolutions;
+
+	// runs the channel groups of a block in parallel, one worker less than groups, up to the number of cores
+	RealtimeWorkerPool channelGroupPool;
+
+	// any thread but the audio thread, both engines load in the background and swap at a block boundary.
+	// decoded is the file as a decode just read it, nullptr reads the file again
+	void loadImpulseResponse(const juce::File& file, std::shared_ptr<const SharedImpulseResponse> decoded = nullptr);
+	// length of the response the selected engine currently runs, 0 until it arrived
+	int getCurrentIRSize() const;
+	// true while a load is queued or running, or until the partitioned engines it built have faded in.
+	// Ask from the thread that calls processBlock, the fade only moves on while blocks are processed
+	bool isLoadingImpulseResponse() const;
+
+	// hybrid mode: the convolution stops at the mixing time and the network, pre-delayed to start there and
+	// level matched to the response, supplies the rest. A mixing time of 0 is estimated from the response.
+	// Reloads the last impulse response, publish the coefficients before loading so the level match can use them.
+	void setHybridMode(bool shouldBeHybrid, double mixingTimeSeconds = 0.0);
+	bool isHybridMode() const;
+	// mixing time of the running hybrid response in seconds, 0 outside hybrid mode
+	std::atomic<double> hybridMixingTime{ 0.0 };
+
+	// per-stage timing of every host block, empty unless built with NN_PROFILING=1
+	StageProfiler profiler;
 private:
-    float nnAudioProcessor::processSignalThroughFilters(float xn, std::vector<juce::IIRFilter>& filters);
+    template <typename SampleType>
+    void process(juce::AudioBuffer<SampleType>& buffer);
+    template <typename SampleType>
+    void processSubBlock(juce::AudioBuffer<SampleType>& buffer, int start, int blockSize, float dryGain, float convolutionGain, float networkGain);
+    template <typename SampleType>
+    void prepareState(PrecisionState<SampleType>& state, Arena& memory, double sampleRate);
+    template <typename SampleType>
+    PrecisionState<SampleType>& getState() noexcept;
+    void applyPendingCoefficients();
+    void applyPendingResponse() noexcept;
+    template <typename SampleType>
+    void stepCoefficientRamps(PrecisionState<SampleType>& state) noexcept;
+    template <typename SampleType>
+    void stageCoefficients(PrecisionState<SampleType>& state, const FilterCoefficientSet& coefficients, int rampBlocks);
+    // what a load reads from the processor, copied by the thread that asks for it so the decode pool reads no members
+    struct LoadSettings
+    {
+        bool hybrid = false;
+        double mixingTime = 0.0;
+        FilterCoefficientSet coefficients;
+        double sampleRate = 0.0;
+        int numGroups = 1;
+    };
+
+    void loadHybridImpulseResponse(const juce::AudioBuffer<float>& response, double impulseResponseRate, const LoadSettings& settings);
+    void loadChannelGroups(std::shared_ptr<const juce::AudioBuffer<float>> impulseResponse, double impulseResponseRate, bool normalise,
+                           const PartitionedConvolution::Handover& handover, const LoadSettings& settings);
+    juce::File getImpulseResponseFile() const;
+    juce::AudioBuffer<float> renderNetworkResponse(const FilterCoefficientSet& coefficients, int numSamples) const;
+
+    // written by the message thread and whoever loads, read by prepareToPlay
+    juce::CriticalSection loadSettingsLock;
+    juce::File impulseResponseFile;
+    FilterCoefficientSet publishedCoefficients;
+    bool hybridMode = false;
+    double userMixingTime = 0.0;
+
+	// sub-block length the scratch is sized to
+	int internalBlockSize = 64;
+
+	// channels processBlock runs, fixed by prepareToPlay, and the groups the impulse response loads fill
+	int numChannels = 2;
+	std::atomic<int> numChannelGroups{ 1 };
+
+	// the handover of the response the convolution runs, taken over by the audio thread together with
+	// that response. 0 and the plain output gain outside hybrid mode
+	std::atomic<int> fdnPreDelay{ 0 };
+	std::atomic<float> fdnOutputGain{ 3.0f };
+
+	OutputStage outputStage;
+	// delay lines and scratch of the prepared precision, nothing is allocated after prepareToPlay
+	Arena arena;
+	// float copy of a double input for the convolution engines, and the spare channel of an odd layout, refers to the arena
+	juce::AudioBuffer<float> convolutionBuffer;
+
+    TripleBuffer<FilterCoefficientSet> coefficientExchange;
+    std::unique_ptr<CoefficientWorkerClient> designWorker;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (nnAudioProcessor)
 };
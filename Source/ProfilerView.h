@@ -0,0 +1,87 @@
+/*
+  ==============================================================================
+
+    ProfilerView.h
+
+    One line of StageProfiler statistics under the editor controls, drained
+    a few times a second: the load of every stage over the last interval, the
+    slowest block of that interval against its deadline, and the blocks that
+    came close to it since the plugin was prepared. Only built with
+    NN_PROFILING=1.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "StageProfiler.h"
+
+#if NN_PROFILING
+class ProfilerView : public juce::Component,
+                     private juce::Timer
+{
+public:
+    explicit ProfilerView(StageProfiler& p) : profiler(p)
+    {
+        addAndMakeVisible(text);
+        text.setFont(juce::Font(juce::Font::getDefaultMonospacedFontName(), 13.0f, juce::Font::plain));
+        startTimerHz(4);
+    }
+
+    void resized() override
+    {
+        text.setBounds(getLocalBounds());
+    }
+
+private:
+    void timerCallback() override
+    {
+        juce::uint64 stageCycles[StageProfiler::numStages] = {};
+        double deadlineCycles = 0.0;
+        double worstLoad = 0.0;
+        double worstSeconds = 0.0;
+        double worstDeadline = 0.0;
+
+        StageProfiler::BlockRecord records[64];
+        for (auto numRecords = profiler.popRecords(records, 64); numRecords > 0; numRecords = profiler.popRecords(records, 64))
+        {
+            for (int i = 0; i < numRecords; i++)
+            {
+                const auto& record = records[i];
+                const auto deadline = profiler.getDeadlineCycles(record.numSamples);
+                for (int stage = 0; stage < StageProfiler::numStages; stage++)
+                    stageCycles[stage] += record.stageCycles[stage];
+                deadlineCycles += deadline;
+
+                if (deadline > 0.0 && record.totalCycles / deadline > worstLoad)
+                {
+                    worstLoad = record.totalCycles / deadline;
+                    worstSeconds = record.totalCycles / profiler.getCyclesPerSecond();
+                    worstDeadline = deadline / profiler.getCyclesPerSecond();
+                }
+            }
+        }
+
+        // nothing processed since the last look, e.g. transport stopped
+        if (deadlineCycles <= 0.0)
+            return;
+
+        juce::String line;
+        for (int stage = 0; stage < StageProfiler::numStages; stage++)
+            line << StageProfiler::getStageName(stage) << " " << juce::String(100.0 * stageCycles[stage] / deadlineCycles, 1) << "%  ";
+
+        line << "| worst " << juce::String(worstSeconds * 1000.0, 2) << " of " << juce::String(worstDeadline * 1000.0, 2) << " ms"
+             << " | xrun risk " << profiler.getNumRiskyBlocks();
+        if (profiler.getNumDroppedRecords() > 0)
+            line << " | dropped " << profiler.getNumDroppedRecords();
+
+        text.setText(line, juce::dontSendNotification);
+    }
+
+    StageProfiler& profiler;
+    juce::Label text;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ProfilerView)
+};
+#endif
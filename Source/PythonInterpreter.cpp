@@ -0,0 +1,88 @@
+/*
+  ==============================================================================
+
+    PythonInterpreter.cpp
+
+  ==============================================================================
+*/
+
+#include "PythonInterpreter.h"
+
+#if NN_PYTHON
+#include "GraphicEQDesigner.h"
+#include "DecayFitNet.h"
+#include "TraceRecorder.h"
+
+// registered with the interpreter before it starts, in the plugin and in the design worker alike
+PYBIND11_EMBEDDED_MODULE(local_calc, m) {
+    // `m` is a `py::module_` which is used to bind functions and classes
+    m.def("add", [](int i, int j) {
+        return i + j;
+        });
+
+    // native designGEQ, returns the 11 x 6 SOS rows
+    m.def("designGEQ", [](const std::array<double, GraphicEQDesigner::numCommandGains>& targetG) {
+        static const GraphicEQDesigner designer;
+        return designer.design(targetG);
+        });
+
+    // native DecayFitNet, T and A as bands x slopes, N and the normalisation per band, see demo_compare_decayFitNet
+    m.def("estimateDecay", [](const std::string& weights, const std::vector<float>& rir, double sampleRate) {
+        DecayFitNet net;
+        if (!net.loadWeights(juce::File(juce::String::fromUTF8(weights.c_str()))))
+            throw std::runtime_error("cannot read DecayFitNet weights " + weights);
+
+        const auto estimate = net.estimate(rir.data(), (int)rir.size(), sampleRate);
+        auto perSlope = [&estimate](const std::vector<double>& values) {
+            std::vector<std::vector<double>> rows;
+            for (int band = 0; band < estimate.numBands; band++)
+                rows.emplace_back(values.begin() + band * estimate.numSlopes, values.begin() + (band + 1) * estimate.numSlopes);
+            return rows;
+        };
+        return pybind11::make_tuple(perSlope(estimate.T), perSlope(estimate.A), estimate.N, estimate.normalisation);
+        });
+
+    // spans of the Python side of a decode, on the clock of the C++ spans, see TraceRecorder.h
+    m.def("trace_now", [] {
+        return TraceRecorder::getInstance().isEnabled() ? TraceRecorder::now() : 0.0;
+        });
+    m.def("trace_span", [](const std::string& name, double start, const std::string& detail) {
+        TraceRecorder::getInstance().addSpan(juce::String::fromUTF8(name.c_str()), "python", start, juce::String::fromUTF8(detail.c_str()));
+        }, pybind11::arg("name"), pybind11::arg("start"), pybind11::arg("detail") = std::string());
+}
+
+namespace
+{
+    // process-wide rather than per shared object: the object goes when the last instance closes, Python stays
+    std::atomic<bool> interpreterStarted{ false };
+}
+
+PythonInterpreter::PythonInterpreter()
+{
+}
+
+PythonInterpreter::~PythonInterpreter()
+{
+    // never finalised, numpy, scipy and torch crash when the interpreter is started a second time.
+    // The process exit takes it down with everything else
+}
+
+void PythonInterpreter::startIfNeeded()
+{
+    JUCE_ASSERT_MESSAGE_THREAD
+
+    if (interpreterStarted)
+        return;
+
+    pybind11::initialize_interpreter();
+    // give up the GIL right away so decode jobs can take it on their own threads. The starting thread's
+    // state is left behind on purpose, nothing takes the GIL back to shut Python down
+    PyEval_SaveThread();
+    interpreterStarted = true;
+}
+
+bool PythonInterpreter::isRunning() const
+{
+    return interpreterStarted;
+}
+#endif
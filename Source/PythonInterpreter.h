@@ -0,0 +1,61 @@
+/*
+  ==============================================================================
+
+    PythonInterpreter.h
+
+    One embedded CPython for the whole process, shared by every plugin
+    instance through juce::SharedResourcePointer. Creating the shared object
+    is free, Python itself only starts the first time a decode asks for it,
+    so host scans and headless renders never pay for the interpreter. Once
+    started it runs until the process exits, even after the last instance
+    closed, because numpy, scipy and torch do not survive a restart.
+
+    Build with NN_PYTHON=0 in the project defines to leave Python out
+    altogether, no headers and no libraries. NN_Render does, so it starts on
+    machines without a Python install; decodes there need converted
+    DecayFitNet weights.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#ifndef NN_PYTHON
+ #define NN_PYTHON 1
+#endif
+
+#if NN_PYTHON
+#include <pybind11/embed.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+class PythonInterpreter
+{
+public:
+    PythonInterpreter();
+    ~PythonInterpreter();
+
+    /** Starts the interpreter if nobody in the process has yet. Message thread only. */
+    void startIfNeeded();
+    bool isRunning() const;
+
+    /** Runs fn with the GIL held. Calls from all instances and threads are serialised,
+        one decode at a time owns the interpreter.
+    */
+    template <typename Function>
+    auto call(Function&& fn) -> decltype(fn())
+    {
+        const juce::ScopedLock sl(callLock);
+        jassert(isRunning());
+        pybind11::gil_scoped_acquire gil;
+        return fn();
+    }
+
+private:
+    juce::CriticalSection callLock;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PythonInterpreter)
+};
+#endif
@@ -0,0 +1,315 @@
+/*
+  ==============================================================================
+
+    RIRDecodeJob.cpp
+
+  ==============================================================================
+*/
+
+#include "RIRDecodeJob.h"
+#include "TraceRecorder.h"
+#include "GraphicEQDesigner.h"
+#include <limits>
+#include <numeric>
+
+#if NN_PYTHON
+ #include <pybind11/numpy.h>
+#endif
+
+RIRDecodeJob::RIRDecodeJob(PythonInterpreter* interpreter, const juce::File& file, const juce::String& directory, std::vector<float> delays,
+                           std::shared_ptr<Status> jobStatus, Callback callback)
+    : juce::ThreadPoolJob("RIR decode"),
+      python(interpreter),
+      rirFile(file),
+      scriptDirectory(directory),
+      delayLines(std::move(delays)),
+      status(std::move(jobStatus)),
+      onFinished(std::move(callback))
+{
+}
+
+RIRDecodeJob::~RIRDecodeJob()
+{
+}
+
+bool RIRDecodeJob::isCancelled()
+{
+    return shouldExit() || status->cancelRequested.load();
+}
+
+juce::String RIRDecodeJob::getStateName(State state)
+{
+    switch (state)
+    {
+        case State::queued:     return "queued";
+        case State::reading:    return "reading";
+        case State::analyzing:  return "analyzing";
+        case State::designing:  return "designing";
+        case State::done:       return "done";
+        case State::failed:     return "failed";
+        case State::cancelled:  return "cancelled";
+    }
+    return {};
+}
+
+juce::ThreadPoolJob::JobStatus RIRDecodeJob::runJob()
+{
+    if (isCancelled())
+    {
+        status->state = State::cancelled;
+        return jobHasFinished;
+    }
+
+    FilterCoefficientSet data;
+    const TraceRecorder::Span jobSpan("RIR decode", "decode", rirFile.getFileName());
+
+    // read once for the analysis and the convolution load after it, with as many channels as the convolution takes
+    status->state = State::reading;
+    const auto rir = [this]
+    {
+        const TraceRecorder::Span span("read RIR", "decode", rirFile.getFullPathName());
+        return SharedImpulseResponse::load(rirFile, ChannelLayout::maxChannels);
+    }();
+
+    if (rir == nullptr)
+    {
+        DBG("cannot read RIR " << rirFile.getFullPathName());
+        status->state = State::failed;
+        return jobHasFinished;
+    }
+
+    // converted weights next to the scripts take Python out of the decode altogether
+    const auto weights = getDecayFitNetWeights(scriptDirectory);
+    auto finalState = State::failed;
+    if (weights.existsAsFile())
+    {
+        finalState = decodeNatively(weights, *rir, data);
+    }
+    else if (python == nullptr)
+    {
+        DBG("no DecayFitNet weights in " << scriptDirectory << " and no Python to run RIR2FDN");
+    }
+    else if (!python->isRunning())
+    {
+        // whoever queues the job starts the interpreter first, on the message thread
+        DBG("no DecayFitNet weights in " << scriptDirectory << " and the Python interpreter is not running");
+    }
+   #if NN_PYTHON
+    else
+    {
+        finalState = decodeWithPython(rir, data);
+    }
+   #endif
+
+    if (finalState != State::done)
+    {
+        status->state = finalState;
+        return jobHasFinished;
+    }
+
+    if (isCancelled())
+    {
+        status->state = State::cancelled;
+        return jobHasFinished;
+    }
+
+    status->progress = 1.0f;
+    status->state = State::done;
+
+    juce::MessageManager::callAsync([callback = onFinished, result = std::move(data), rir]
+    {
+        callback(result, rir);
+    });
+
+    return jobHasFinished;
+}
+
+#if NN_PYTHON
+RIRDecodeJob::State RIRDecodeJob::decodeWithPython(const std::shared_ptr<const SharedImpulseResponse>& rir, FilterCoefficientSet& data)
+{
+    auto& trace = TraceRecorder::getInstance();
+
+    // waits here while another instance's decode owns the interpreter
+    const auto waitStart = trace.isEnabled() ? TraceRecorder::now() : 0.0;
+    return python->call([this, &rir, &data, &trace, waitStart]
+    {
+        trace.addSpan("wait for interpreter", "decode", waitStart);
+
+        try
+        {
+            // once per directory, the interpreter outlives every decode and would collect a copy per call
+            auto path = pybind11::module_::import("sys").attr("path");
+            const auto directory = pybind11::str(scriptDirectory.toStdString());
+            if (!path.contains(directory))
+                path.attr("insert")(0, directory);
+
+            // import module, the first import of a session loads numpy, scipy and DecayFitNet
+            auto external_module = [this]
+            {
+                const TraceRecorder::Span span("import external", "decode", scriptDirectory);
+                return pybind11::module_::import("external");
+            }();
+
+            // RIR2FDN reports each stage and aborts when we answer False
+            auto progress = pybind11::cpp_function([this](const std::string& stage, float fraction)
+            {
+                if (stage == "reading")         status->state = State::reading;
+                else if (stage == "analyzing")  status->state = State::analyzing;
+                else if (stage == "designing")  status->state = State::designing;
+
+                status->progress = fraction;
+                return !isCancelled();
+            });
+
+            // the first channel as a read-only float32 view, the capsule keeps the samples alive as long as numpy holds it
+            auto owner = pybind11::capsule(new std::shared_ptr<const SharedImpulseResponse>(rir), [](void* p)
+            {
+                delete static_cast<std::shared_ptr<const SharedImpulseResponse>*>(p);
+            });
+            pybind11::array_t<float> samples({ (pybind11::ssize_t)rir->getSamples().getNumSamples() }, { (pybind11::ssize_t)sizeof(float) },
+                                             rir->getSamples().getReadPointer(0), owner);
+            samples.attr("setflags")(pybind11::arg("write") = false);
+
+            // execute python function, one absorption cascade is designed per delay line
+            auto output = [&]
+            {
+                const TraceRecorder::Span span("RIR2FDN", "decode");
+                return external_module.attr("RIR2FDN")(rirFile.getFullPathName().toStdString(),
+                    *pybind11::cast(delayLines), pybind11::arg("progress") = progress,
+                    pybind11::arg("rir") = samples, pybind11::arg("fs") = rir->getSampleRate(),
+                    pybind11::arg("scale") = rir->getAnalysisScale());
+            }();
+
+            const TraceRecorder::Span span("copy coefficients", "decode");
+            if (!copy_ndarray_to_tensor(output, data))
+            {
+                DBG("RIR decode returned an unexpected coefficient shape");
+                return State::failed;
+            }
+        }
+        catch (const pybind11::error_already_set& e)
+        {
+            // a DecodeCancelled raised from the progress callback ends up here as well
+            DBG("RIR decode stopped: " << e.what());
+            return isCancelled() ? State::cancelled : State::failed;
+        }
+
+        return State::done;
+    });
+}
+#endif
+
+RIRDecodeJob::State RIRDecodeJob::decodeNatively(const juce::File& weights, const SharedImpulseResponse& rir, FilterCoefficientSet& data)
+{
+    DecayFitNet net;
+    if (!net.loadWeights(weights))
+    {
+        DBG("cannot read DecayFitNet weights " << weights.getFullPathName());
+        return State::failed;
+    }
+
+    status->state = State::analyzing;
+    if (!analyse(net, rir, delayLines, data))
+        return State::failed;
+
+    return isCancelled() ? State::cancelled : State::done;
+}
+
+juce::File RIRDecodeJob::getDecayFitNetWeights(const juce::String& scriptDirectory)
+{
+    return juce::File::isAbsolutePath(scriptDirectory) ? juce::File(scriptDirectory).getChildFile("DecayFitNet.weights") : juce::File();
+}
+
+bool RIRDecodeJob::canDecodeNatively(const juce::String& scriptDirectory)
+{
+    return getDecayFitNetWeights(scriptDirectory).existsAsFile();
+}
+
+bool RIRDecodeJob::analyse(const DecayFitNet& net, const SharedImpulseResponse& rir, const std::vector<float>& delayLines, FilterCoefficientSet& coefficients)
+{
+    // RIR2FDN and RIR2AbsCoefLvlCoef of external.py, step by step
+    constexpr int numOctaves = bandSize - 3;
+    const auto& filterFrequencies = net.getFilterFrequencies();
+    if ((int)filterFrequencies.size() != numOctaves || (int)delayLines.size() != delaySize)
+        return false;
+
+    const auto numSamples = rir.getSamples().getNumSamples();
+    const auto fs = rir.getSampleRate();
+    if (numSamples < 2)
+        return false;
+
+    // wavio data scaled by 2^(bits - 1) - 1 rather than the 2^(bits - 1) of the reader, on the one channel analysed
+    std::vector<float> mono(rir.getSamples().getReadPointer(0), rir.getSamples().getReadPointer(0) + numSamples);
+    juce::FloatVectorOperations::multiply(mono.data(), (float)rir.getAnalysisScale(), numSamples);
+
+    const auto estimate = [&]
+    {
+        const TraceRecorder::Span span("DecayFitNet native", "decode");
+        return net.estimate(mono.data(), numSamples, fs);
+    }();
+
+    // decayFitNet2InitialLevel: the level of the first slope from its energy, the energy of the band filter and the decay
+    std::array<double, numOctaves> decayTime, level;
+    const auto impulseLength = (int)fs + 1;
+    std::vector<float> impulse((size_t)impulseLength, 0.0f);
+    std::vector<double> response((size_t)impulseLength);
+    impulse[0] = 1.0f;
+
+    for (int band = 0; band < numOctaves; band++)
+    {
+        DecayFitNet::filter(DecayFitNet::designOctaveBand(filterFrequencies[(size_t)band], fs), impulse.data(), response.data(), impulseLength);
+        const auto bandEnergy = std::inner_product(response.begin(), response.end(), response.begin(), 0.0);
+
+        decayTime[(size_t)band] = estimate.getT(band) > 0.0 ? estimate.getT(band) : std::numeric_limits<double>::epsilon();
+        const auto gainPerSample = std::pow(10.0, -3.0 / (decayTime[(size_t)band] * fs));
+        const auto decayEnergy = 1.0 / (1.0 - gainPerSample * gainPerSample);
+        const auto amplitude = estimate.getA(band) * estimate.normalisation[(size_t)band];
+        level[(size_t)band] = std::sqrt(amplitude / bandEnergy / decayEnergy * numSamples);
+    }
+
+    // command gains at [1 Hz, 63 ... 8000 Hz, fs], the outer bands repeat their neighbours
+    std::array<double, GraphicEQDesigner::numCommandGains> slope, levelGains;
+    for (int gain = 0; gain < GraphicEQDesigner::numCommandGains; gain++)
+    {
+        const auto band = juce::jlimit(0, numOctaves - 1, gain - 1);
+        slope[(size_t)gain] = -60.0 / (decayTime[(size_t)band] * fs);
+        levelGains[(size_t)gain] = 20.0 * std::log10(level[(size_t)band]);
+    }
+
+    const TraceRecorder::Span span("designGEQ native", "decode");
+    const GraphicEQDesigner designer;
+    auto store = [&coefficients](int row, const GraphicEQDesigner::SOS& sos)
+    {
+        for (int band = 0; band < FilterCoefficientSet::bands; band++)
+            std::copy(sos[(size_t)band].begin(), sos[(size_t)band].end(), coefficients.section(row, band));
+    };
+
+    for (int line = 0; line < delaySize; line++)
+    {
+        auto targetGains = slope;
+        for (auto& gain : targetGains)
+            gain *= delayLines[(size_t)line];
+        store(line, designer.design(targetGains));
+    }
+    store(delaySize, designer.design(levelGains));
+
+    return coefficients.isValid();
+}
+
+#if NN_PYTHON
+bool RIRDecodeJob::copy_ndarray_to_tensor(pybind11::handle ndarray, FilterCoefficientSet& tensor)
+{
+    // a C contiguous float64 array is taken through the buffer protocol as is, anything else is converted once
+    auto array = pybind11::array_t<double, pybind11::array::c_style | pybind11::array::forcecast>::ensure(ndarray);
+
+    if (!array || array.ndim() != 3
+        || array.shape(0) != FilterCoefficientSet::numRows
+        || array.shape(1) != FilterCoefficientSet::bands
+        || array.shape(2) != FilterCoefficientSet::sectionSize)
+        return false;
+
+    // the job outlives the GIL scope, so the whole tensor is copied out in one go
+    std::copy_n(array.data(), FilterCoefficientSet::size, tensor.data);
+    return tensor.isValid();
+}
+#endif
@@ -0,0 +1,88 @@
+/*
+  ==============================================================================
+
+    RIRDecodeJob.h
+
+    Runs the Python RIR2FDN pipeline (wav read, DecayFitNet analysis, GEQ
+    design) on a thread pool instead of the message thread. Progress and the
+    current stage are published through a shared Status the editor polls,
+    and the result is handed back on the message thread. With converted
+    DecayFitNet weights next to the scripts the same pipeline runs natively
+    and Python is never started. In the plugin the file is read once either
+    way: the callback hands the job's SharedImpulseResponse to the
+    convolution load that follows. A decode in NN_Worker cannot pass its
+    samples across the pipe, so the plugin reads the file again there.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "CoefficientTensor.h"
+#include "PythonInterpreter.h"
+#include "DecayFitNet.h"
+#include "SharedImpulseResponse.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// declared without Python too, the job then simply never gets one
+class PythonInterpreter;
+
+class RIRDecodeJob : public juce::ThreadPoolJob
+{
+public:
+    enum class State { queued, reading, analyzing, designing, done, failed, cancelled };
+
+    // shared between the job and whoever started it, so it outlives either side
+    struct Status
+    {
+        std::atomic<State> state{ State::queued };
+        std::atomic<float> progress{ 0.0f };
+        std::atomic<bool> cancelRequested{ false };
+    };
+
+    // called on the message thread once the job is done, with the response the job read so the convolution load
+    // that follows can take it over; nullptr when the decode ran in another process
+    using Callback = std::function<void(const FilterCoefficientSet&, std::shared_ptr<const SharedImpulseResponse>)>;
+
+    /** python may be nullptr, e.g. in a build with NN_PYTHON=0; only converted weights decode then.
+        A decode that needs Python fails unless the caller started the interpreter.
+    */
+    RIRDecodeJob(PythonInterpreter* python, const juce::File& rirFile, const juce::String& scriptDirectory, std::vector<float> delayLines,
+                 std::shared_ptr<Status> status, Callback onFinished);
+    ~RIRDecodeJob() override;
+
+    JobStatus runJob() override;
+
+    static juce::String getStateName(State state);
+
+    /** DecayFitNet.weights in the script directory, see export_decayfitnet_weights in external.py. */
+    static juce::File getDecayFitNetWeights(const juce::String& scriptDirectory);
+    static bool canDecodeNatively(const juce::String& scriptDirectory);
+
+    /** RIR2FDN in C++: the native DecayFitNet and GraphicEQDesigner on the first channel of the response.
+        False if the response is too short or the network does not analyse the GEQ's octave bands.
+    */
+    static bool analyse(const DecayFitNet& net, const SharedImpulseResponse& rir, const std::vector<float>& delayLines,
+                        FilterCoefficientSet& coefficients);
+
+private:
+    bool isCancelled();
+   #if NN_PYTHON
+    State decodeWithPython(const std::shared_ptr<const SharedImpulseResponse>& rir, FilterCoefficientSet& data);
+    static bool copy_ndarray_to_tensor(pybind11::handle ndarray, FilterCoefficientSet& tensor);
+   #endif
+    State decodeNatively(const juce::File& weights, const SharedImpulseResponse& rir, FilterCoefficientSet& data);
+
+    PythonInterpreter* python;
+    juce::File rirFile;
+    juce::String scriptDirectory;
+    std::vector<float> delayLines;
+    std::shared_ptr<Status> status;
+    Callback onFinished;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RIRDecodeJob)
+};
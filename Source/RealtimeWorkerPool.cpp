@@ -0,0 +1,90 @@
+/*
+  ==============================================================================
+
+    RealtimeWorkerPool.cpp
+
+  ==============================================================================
+*/
+
+#include "RealtimeWorkerPool.h"
+
+//==============================================================================
+class RealtimeWorkerPool::Worker : public juce::Thread
+{
+public:
+	explicit Worker(RealtimeWorkerPool& p) : juce::Thread("NN channel group worker"), pool(p) {}
+
+	~Worker() override
+	{
+		// the signal gets it out of a sleeping wait
+		signalThreadShouldExit();
+		jobsAvailable.signal();
+		stopThread(2000);
+	}
+
+	void run() override
+	{
+		// the jobs are audio code like the caller's
+		juce::ScopedNoDenormals noDenormals;
+
+		while (!threadShouldExit())
+		{
+			jobsAvailable.wait();
+			pool.runJobs();
+		}
+	}
+
+	WorkerSignal jobsAvailable;
+
+private:
+	RealtimeWorkerPool& pool;
+};
+
+//==============================================================================
+RealtimeWorkerPool::RealtimeWorkerPool()
+{
+}
+
+RealtimeWorkerPool::~RealtimeWorkerPool()
+{
+	setNumWorkers(0);
+}
+
+void RealtimeWorkerPool::setNumWorkers(int numWorkers)
+{
+	numWorkers = juce::jmax(0, numWorkers);
+	if (numWorkers == workers.size())
+		return;
+
+	workers.clear();
+
+	for (int i = 0; i < numWorkers; i++)
+	{
+		// scheduled like the audio thread whose jobs they share, where the system allows it
+		auto* worker = workers.add(new Worker(*this));
+		if (!worker->startRealtimeThread(juce::Thread::RealtimeOptions{}))
+			worker->startThread(juce::Thread::Priority::highest);
+	}
+}
+
+void RealtimeWorkerPool::wakeWorkers() noexcept
+{
+	// no lock, and a system call only for workers that have gone to sleep since the last call
+	for (auto* worker : workers)
+		worker->jobsAvailable.signal();
+}
+
+void RealtimeWorkerPool::runJobs() noexcept
+{
+	for (;;)
+	{
+		// acquire pairs with the release in parallelFor(), so the context of that call is visible
+		const auto taken = jobs.fetch_add(1, std::memory_order_acquire);
+		const auto index = (int)(taken & 0xffffffff);
+		if (index >= (int)(taken >> 32))
+			return;
+
+		invoke(context, index);
+		jobsRemaining.fetch_sub(1, std::memory_order_acq_rel);
+	}
+}
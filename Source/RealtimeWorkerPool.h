@@ -0,0 +1,77 @@
+/*
+  ==============================================================================
+
+    RealtimeWorkerPool.h
+
+    Fork-join helper for the audio thread. A fixed set of realtime threads,
+    started outside the audio callback, waits for work on a WorkerSignal;
+    parallelFor() wakes them, hands out job indices through one atomic word
+    and runs jobs on the calling thread too, so the audio thread never waits
+    for a worker to wake up. It only spins for jobs a worker has already
+    started. Nothing is allocated or locked per call.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include "WorkerSignal.h"
+
+class RealtimeWorkerPool
+{
+public:
+	RealtimeWorkerPool();
+	~RealtimeWorkerPool();
+
+	/** Stops the current workers and starts numWorkers new ones, 0 runs everything on the caller.
+		Not concurrent with parallelFor(), e.g. from prepareToPlay.
+	*/
+	void setNumWorkers(int numWorkers);
+	int getNumWorkers() const noexcept                  { return workers.size(); }
+
+	/** Calls job(index) for every index in [0, numJobs) and returns once all of them are done.
+		The jobs have to be independent of each other.
+	*/
+	template <typename Job>
+	void parallelFor(int numJobs, Job& job) noexcept
+	{
+		if (workers.isEmpty() || numJobs <= 1)
+		{
+			for (int index = 0; index < numJobs; index++)
+				job(index);
+			return;
+		}
+
+		context = &job;
+		invoke = [](void* c, int index) { (*static_cast<Job*>(c))(index); };
+		jobsRemaining.store(numJobs, std::memory_order_relaxed);
+		jobs.store((juce::uint64)numJobs << 32, std::memory_order_release);
+
+		wakeWorkers();
+		runJobs();
+
+		// only jobs a worker is already running are left, the spin does not give up the audio thread's time slice
+		while (jobsRemaining.load(std::memory_order_acquire) > 0)
+			WorkerSignal::pause();
+
+		// workers that arrive late find no jobs rather than an index of the next call
+		jobs.store(0, std::memory_order_relaxed);
+	}
+
+private:
+	class Worker;
+
+	void wakeWorkers() noexcept;
+	void runJobs() noexcept;
+
+	juce::OwnedArray<Worker> workers;
+	void* context = nullptr;
+	void (*invoke)(void*, int) = nullptr;
+	// job count in the upper half, next index in the lower, so one increment hands out an index of a consistent call
+	std::atomic<juce::uint64> jobs{ 0 };
+	std::atomic<int> jobsRemaining{ 0 };
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RealtimeWorkerPool)
+};
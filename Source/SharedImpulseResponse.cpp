@@ -0,0 +1,54 @@
+/*
+  ==============================================================================
+
+    SharedImpulseResponse.cpp
+
+  ==============================================================================
+*/
+
+#include "SharedImpulseResponse.h"
+#include <cmath>
+#include <limits>
+
+std::unique_ptr<juce::AudioFormatReader> SharedImpulseResponse::createReader(const juce::File& file)
+{
+	// decoded from the page cache, no read buffer and no second copy of the file in memory
+	std::unique_ptr<juce::MemoryMappedAudioFormatReader> mapped;
+	if (file.hasFileExtension("wav;bwf"))
+		mapped.reset(juce::WavAudioFormat().createMemoryMappedReader(file));
+	else if (file.hasFileExtension("aif;aiff"))
+		mapped.reset(juce::AiffAudioFormat().createMemoryMappedReader(file));
+
+	if (mapped != nullptr && mapped->mapEntireFile())
+		return mapped;
+
+	juce::AudioFormatManager formatManager;
+	formatManager.registerBasicFormats();
+	return std::unique_ptr<juce::AudioFormatReader>(formatManager.createReaderFor(file));
+}
+
+std::shared_ptr<const SharedImpulseResponse> SharedImpulseResponse::load(const juce::File& file, int maxNumChannels)
+{
+	auto reader = createReader(file);
+	if (reader == nullptr || reader->lengthInSamples <= 0 || reader->lengthInSamples > std::numeric_limits<int>::max())
+		return {};
+
+	auto result = std::make_shared<SharedImpulseResponse>();
+	result->sampleRate = reader->sampleRate;
+	result->bitsPerSample = reader->bitsPerSample;
+	result->floatingPoint = reader->usesFloatingPointData;
+	result->samples.setSize(juce::jlimit(1, juce::jmax(1, maxNumChannels), (int)reader->numChannels), (int)reader->lengthInSamples);
+	if (!reader->read(&result->samples, 0, result->samples.getNumSamples(), 0, true, true))
+		return {};
+
+	return result;
+}
+
+double SharedImpulseResponse::getAnalysisScale() const noexcept
+{
+	if (floatingPoint || bitsPerSample < 2)
+		return 1.0;
+
+	const auto fullScale = std::pow(2.0, (double)bitsPerSample - 1.0);
+	return fullScale / (fullScale - 1.0);
+}
@@ -0,0 +1,47 @@
+/*
+  ==============================================================================
+
+    SharedImpulseResponse.h
+
+    One decoded copy of an impulse response file for everything in the
+    process that needs it: the coefficient analysis (native, or Python
+    through a read-only numpy view of the samples) and the convolution
+    loaders. WAV and AIFF files are decoded straight from a memory mapped
+    view of the file, other formats through the streaming reader. Nothing
+    is cached: the decode job hands its copy to the convolution load that
+    follows it, and the samples are freed with the last engine using them.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <memory>
+
+class SharedImpulseResponse
+{
+public:
+	/** The decoded file with up to maxNumChannels channels, nullptr if it cannot be read. Any thread. */
+	static std::shared_ptr<const SharedImpulseResponse> load(const juce::File& file, int maxNumChannels);
+
+	const juce::AudioBuffer<float>& getSamples() const noexcept        { return samples; }
+	double getSampleRate() const noexcept                               { return sampleRate; }
+
+	/** Factor from the reader's full scale to that of wavio.read in RIR2FDN, which divides integer
+		samples by 2^(bits - 1) - 1 rather than 2^(bits - 1).
+	*/
+	double getAnalysisScale() const noexcept;
+
+	SharedImpulseResponse() = default;
+
+private:
+	static std::unique_ptr<juce::AudioFormatReader> createReader(const juce::File& file);
+
+	juce::AudioBuffer<float> samples;
+	double sampleRate = 0.0;
+	unsigned int bitsPerSample = 0;
+	bool floatingPoint = false;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SharedImpulseResponse)
+};
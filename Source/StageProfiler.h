@@ -0,0 +1,233 @@
+/*
+  ==============================================================================
+
+    StageProfiler.h
+
+    Per-stage CPU time of processBlock, to see how many instances a machine
+    can carry. The audio thread reads the CPU's cycle counter between the
+    stages, adds up the sub-blocks of a host block and pushes one record per
+    host block into a lock-free single producer, single consumer ring that
+    the editor drains. A full ring drops the record and counts it, the audio
+    thread never waits. Blocks that come close to their deadline are counted
+    on the audio thread, so that counter stays exact when records are lost.
+    The cycle counter is measured against the system clock once per process,
+    over the first blocks after prepare(); until then no block counts as a
+    risk and the editor shows nothing.
+
+    Build with NN_PROFILING=1 in the project defines. Otherwise every call is
+    an empty inline function and the instrumentation compiles to nothing.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#ifndef NN_PROFILING
+ #define NN_PROFILING 0
+#endif
+
+#if NN_PROFILING && JUCE_INTEL
+ #if JUCE_MSVC
+  #include <intrin.h>
+ #else
+  #include <x86intrin.h>
+ #endif
+#endif
+
+class StageProfiler
+{
+public:
+	// the transition filters run inside the parallel channel group jobs and are part of that stage
+	enum Stage { dry, network, channelGroups, mix, numStages };
+
+	static const char* getStageName(int stage) noexcept
+	{
+		static const char* names[] = { "dry copy", "network", "convolution", "mix" };
+		return names[stage];
+	}
+
+	StageProfiler()
+	{
+	};
+
+	~StageProfiler()
+	{
+	};
+
+#if NN_PROFILING
+	struct BlockRecord
+	{
+		juce::uint64 stageCycles[numStages];
+		// the whole callback, coefficient hand-off and sub-block loop included
+		juce::uint64 totalCycles;
+		int numSamples;
+		// the prepare() the record belongs to
+		int generation;
+	};
+
+	// share of the block period above which a block counts as an xrun risk, the host, the driver and
+	// every other plugin have to fit into the rest
+	static constexpr double riskThreshold = 0.7;
+
+	/** Clears the statistics, from prepareToPlay. The editor may be reading the ring meanwhile, so the records
+		of the previous configuration stay in it and popRecords() skips them by their generation.
+	*/
+	void prepare(double newSampleRate)
+	{
+		sampleRate.store(newSampleRate, std::memory_order_relaxed);
+		calibrationCycles = now();
+		calibrationTicks = juce::Time::getHighResolutionTicks();
+		riskyBlocks = 0;
+		droppedRecords = 0;
+		generation.fetch_add(1, std::memory_order_release);
+	}
+
+	//==============================================================================
+	// audio thread
+
+	void beginBlock() noexcept
+	{
+		blockStart = now();
+		std::fill(std::begin(current.stageCycles), std::end(current.stageCycles), (juce::uint64)0);
+	}
+
+	juce::uint64 start() noexcept                                { return now(); }
+
+	/** Adds the time since stageStart to the stage and returns the start of the next one. */
+	juce::uint64 lap(Stage stage, juce::uint64 stageStart) noexcept
+	{
+		const auto time = now();
+		current.stageCycles[stage] += time - stageStart;
+		return time;
+	}
+
+	void endBlock(int numSamples) noexcept
+	{
+		current.totalCycles = now() - blockStart;
+		current.numSamples = numSamples;
+		current.generation = generation.load(std::memory_order_relaxed);
+
+		if (getCyclesPerSecond() <= 0.0)
+			calibrate();
+
+		const auto deadline = getDeadlineCycles(numSamples);
+		if (deadline > 0.0 && (double)current.totalCycles > riskThreshold * deadline)
+			riskyBlocks.fetch_add(1, std::memory_order_relaxed);
+
+		int start1, size1, start2, size2;
+		fifo.prepareToWrite(1, start1, size1, start2, size2);
+		if (size1 > 0)
+			records[(size_t)start1] = current;
+		else
+			droppedRecords.fetch_add(1, std::memory_order_relaxed);
+		fifo.finishedWrite(size1);
+	}
+
+	//==============================================================================
+	// editor, one reader at a time
+
+	/** Moves up to maxRecords of the oldest records of the current prepare() into destination and returns how many,
+		0 once the ring is empty. Older records are dropped on the way.
+	*/
+	int popRecords(BlockRecord* destination, int maxRecords) noexcept
+	{
+		const auto wanted = generation.load(std::memory_order_acquire);
+		int numPopped = 0;
+		while (numPopped == 0)
+		{
+			int start1, size1, start2, size2;
+			fifo.prepareToRead(maxRecords, start1, size1, start2, size2);
+			if (size1 + size2 == 0)
+				break;
+
+			const auto isCurrent = [wanted](const BlockRecord& record) { return record.generation == wanted; };
+			auto end = std::copy_if(records.begin() + start1, records.begin() + start1 + size1, destination, isCurrent);
+			end = std::copy_if(records.begin() + start2, records.begin() + start2 + size2, end, isCurrent);
+			fifo.finishedRead(size1 + size2);
+			numPopped = (int)(end - destination);
+		}
+		return numPopped;
+	}
+
+	/** Cycles the block period of numSamples samples lasts, 0 until the counter is calibrated. */
+	double getDeadlineCycles(int numSamples) const noexcept
+	{
+		const auto rate = sampleRate.load(std::memory_order_relaxed);
+		return rate > 0.0 ? numSamples / rate * getCyclesPerSecond() : 0.0;
+	}
+
+	/** The same for every profiler of the process, 0 until the first one has calibrated the counter. */
+	static double getCyclesPerSecond() noexcept                 { return cyclesPerSecond().load(std::memory_order_relaxed); }
+	int getNumRiskyBlocks() const noexcept                      { return riskyBlocks.load(); }
+	int getNumDroppedRecords() const noexcept                   { return droppedRecords.load(); }
+
+private:
+	static constexpr int ringSize = 1024;
+
+	static juce::uint64 now() noexcept
+	{
+	   #if JUCE_INTEL
+		return (juce::uint64)__rdtsc();
+	   #elif JUCE_ARM && defined(__aarch64__)
+		juce::uint64 ticks;
+		asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+		return ticks;
+	   #else
+		return (juce::uint64)juce::Time::getHighResolutionTicks();
+	   #endif
+	}
+
+	// constant initialised, so the audio thread never runs a static guard for it
+	static std::atomic<double>& cyclesPerSecond() noexcept
+	{
+		static std::atomic<double> value{ 0.0 };
+		return value;
+	}
+
+	/** Audio thread, until the counter is known. The time stamp counter is measured against the system clock
+		over the time since prepare(), so prepareToPlay does not have to sleep for it.
+	*/
+	void calibrate() noexcept
+	{
+	   #if JUCE_INTEL
+		const auto ticks = juce::Time::getHighResolutionTicks() - calibrationTicks;
+		if (ticks < juce::Time::secondsToHighResolutionTicks(calibrationSeconds))
+			return;
+
+		const auto rate = (double)(now() - calibrationCycles) * (double)juce::Time::getHighResolutionTicksPerSecond() / (double)ticks;
+	   #elif JUCE_ARM && defined(__aarch64__)
+		juce::uint64 frequency;
+		asm volatile("mrs %0, cntfrq_el0" : "=r"(frequency));
+		const auto rate = (double)frequency;
+	   #else
+		const auto rate = (double)juce::Time::getHighResolutionTicksPerSecond();
+	   #endif
+		cyclesPerSecond().store(rate, std::memory_order_relaxed);
+	}
+
+	// far beyond the resolution of the system clock, the rate comes out within a few parts per million
+	static constexpr double calibrationSeconds = 0.02;
+
+	std::atomic<double> sampleRate{ 0.0 };
+	juce::uint64 calibrationCycles = 0;
+	juce::int64 calibrationTicks = 0;
+	juce::uint64 blockStart = 0;
+	BlockRecord current{};
+
+	juce::AbstractFifo fifo{ ringSize };
+	std::array<BlockRecord, ringSize> records{};
+	std::atomic<int> riskyBlocks{ 0 };
+	std::atomic<int> droppedRecords{ 0 };
+	std::atomic<int> generation{ 0 };
+#else
+	void prepare(double) {}
+	void beginBlock() noexcept {}
+	juce::uint64 start() noexcept                                { return 0; }
+	juce::uint64 lap(Stage, juce::uint64) noexcept               { return 0; }
+	void endBlock(int) noexcept {}
+#endif
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StageProfiler)
+};
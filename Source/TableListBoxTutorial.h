@@ -1,5 +1,6 @@
 #pragma once
 #include <JuceHeader.h>
+#include <array>
 #include <iostream>
 #include <string>
 
@@ -7,11 +8,18 @@
 class DataEntry
 {
 public:
-    DataEntry(const std::vector<float>& values) : data(values)
+    // channel, band, then the six { b0, b1, b2, a0, a1, a2 } values of one section
+    DataEntry(int channel, int band, const double* section)
     {
+        data[0] = (float)channel;
+        data[1] = (float)band;
+        for (size_t i = 0; i < 6; i++)
+        {
+            data[i + 2] = (float)section[i];
+        }
     }
 
-    std::vector<float> data;
+    std::array<float, 8> data;
 };
 
 class CoefficientTableComponent : public juce::Component, 
@@ -40,14 +48,9 @@ public:
         entries.clear();
     }
 
-    void update_entry(int channel, int band, std::vector<float> input_data)
+    void update_entry(int channel, int band, const double* section)
     {
-        if (input_data.size() == 6)
-        {
-            input_data.insert(input_data.begin(), channel);
-            input_data.insert(input_data.begin() + 1, band);
-            entries.push_back(DataEntry(input_data));
-        }
+        entries.push_back(DataEntry(channel, band, section));
         table.updateContent();
     }
 
@@ -0,0 +1,117 @@
+/*
+  ==============================================================================
+
+    TraceRecorder.cpp
+
+  ==============================================================================
+*/
+
+#include "TraceRecorder.h"
+
+TraceRecorder& TraceRecorder::getInstance()
+{
+    static TraceRecorder recorder;
+    return recorder;
+}
+
+TraceRecorder::TraceRecorder()
+{
+    const auto path = juce::SystemStats::getEnvironmentVariable("NN_TRACE", {});
+    if (path.isNotEmpty() && juce::File::isAbsolutePath(path))
+    {
+        directory = juce::File(path);
+        enabled = directory.createDirectory().wasOk();
+    }
+}
+
+void TraceRecorder::setProcessName(const juce::String& name, int id)
+{
+    const juce::ScopedLock sl(lock);
+    processName = name;
+    processId = id;
+}
+
+double TraceRecorder::now() noexcept
+{
+    return (double)juce::Time::getHighResolutionTicks() * 1.0e6 / (double)juce::Time::getHighResolutionTicksPerSecond();
+}
+
+void TraceRecorder::addSpan(const juce::String& name, const char* category, double startMicros, const juce::String& detail)
+{
+    if (!enabled)
+        return;
+
+    const auto end = now();
+    const auto threadId = (juce::int64)(juce::pointer_sized_int)juce::Thread::getCurrentThreadId();
+
+    juce::String threadName;
+    if (auto* thread = juce::Thread::getCurrentThread())
+        threadName = thread->getThreadName();
+    else if (juce::MessageManager::existsAndIsCurrentThread())
+        threadName = "message thread";
+    else
+        threadName = "thread " + juce::String::toHexString(threadId);
+
+    const juce::ScopedLock sl(lock);
+    if (events.size() >= maxEvents)
+        return;
+
+    events.push_back({ name, category, detail, startMicros, end - startMicros, threadId });
+    threadNames.emplace(threadId, threadName);
+}
+
+bool TraceRecorder::write()
+{
+    if (!enabled)
+        return false;
+
+    juce::Array<juce::var> traceEvents;
+
+    const juce::ScopedLock sl(lock);
+
+    auto metadata = [this](const char* type, juce::int64 threadId, const juce::String& value)
+    {
+        auto* args = new juce::DynamicObject();
+        args->setProperty("name", value);
+
+        auto* event = new juce::DynamicObject();
+        event->setProperty("name", type);
+        event->setProperty("ph", "M");
+        event->setProperty("pid", processId);
+        event->setProperty("tid", threadId);
+        event->setProperty("args", juce::var(args));
+        return juce::var(event);
+    };
+
+    traceEvents.add(metadata("process_name", 0, processName));
+    for (const auto& thread : threadNames)
+        traceEvents.add(metadata("thread_name", thread.first, thread.second));
+
+    // complete events, one per span, timestamps and durations in microseconds
+    for (const auto& span : events)
+    {
+        auto* event = new juce::DynamicObject();
+        event->setProperty("name", span.name);
+        event->setProperty("cat", span.category);
+        event->setProperty("ph", "X");
+        event->setProperty("ts", span.start);
+        event->setProperty("dur", span.duration);
+        event->setProperty("pid", processId);
+        event->setProperty("tid", span.threadId);
+
+        if (span.detail.isNotEmpty())
+        {
+            auto* args = new juce::DynamicObject();
+            args->setProperty("detail", span.detail);
+            event->setProperty("args", juce::var(args));
+        }
+
+        traceEvents.add(juce::var(event));
+    }
+
+    auto* trace = new juce::DynamicObject();
+    trace->setProperty("traceEvents", traceEvents);
+    trace->setProperty("displayTimeUnit", "ms");
+
+    return directory.getChildFile(processName + ".json").replaceWithText(juce::JSON::toString(juce::var(trace), true));
+}
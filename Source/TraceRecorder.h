@@ -0,0 +1,99 @@
+/*
+  ==============================================================================
+
+    TraceRecorder.h
+
+    Named spans of the RIR-to-audio pipeline (file reads, Python, DecayFitNet,
+    the GEQ designs, coefficient hand-off, partition FFTs), written as Chrome
+    trace-event JSON that chrome://tracing and ui.perfetto.dev open. One
+    recorder per process, spans come from any thread except the audio thread
+    and from Python through local_calc.trace_now() / trace_span().
+
+    Off unless NN_TRACE names a directory; then every finished load rewrites
+    <directory>/<process>.json with everything recorded so far. The plugin and
+    NN_Worker write separate files on the same monotonic clock, so their
+    traceEvents arrays can be concatenated into one timeline.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <map>
+#include <vector>
+
+class TraceRecorder
+{
+public:
+    /** The recorder of this process, shared by every plugin instance in it. */
+    static TraceRecorder& getInstance();
+
+    /** Name the trace file and the process row are given, "NN_Func" unless changed at startup. */
+    void setProcessName(const juce::String& name, int processId);
+
+    bool isEnabled() const noexcept                 { return enabled; }
+
+    /** Microseconds on the clock all spans use, shared by the processes of one machine. */
+    static double now() noexcept;
+
+    /** Records a span of the calling thread from startMicros until now. */
+    void addSpan(const juce::String& name, const char* category, double startMicros, const juce::String& detail = {});
+
+    /** Writes everything recorded so far, false when tracing is off or the file cannot be written. */
+    bool write();
+
+    //==============================================================================
+    /** Records its own lifetime as a span of the calling thread. */
+    class Span
+    {
+    public:
+        Span(const char* spanName, const char* spanCategory, const juce::String& spanDetail = {})
+            : name(spanName), category(spanCategory), detail(spanDetail),
+              start(getInstance().isEnabled() ? now() : 0.0)
+        {
+        }
+
+        ~Span()
+        {
+            auto& recorder = getInstance();
+            if (recorder.isEnabled())
+                recorder.addSpan(name, category, start, detail);
+        }
+
+    private:
+        const char* name;
+        const char* category;
+        juce::String detail;
+        double start;
+
+        JUCE_DECLARE_NON_COPYABLE (Span)
+    };
+
+private:
+    TraceRecorder();
+
+    struct Event
+    {
+        juce::String name;
+        const char* category;
+        juce::String detail;
+        double start;
+        double duration;
+        juce::int64 threadId;
+    };
+
+    // a long session of loads stays far below this, it only guards against a runaway loop
+    static constexpr size_t maxEvents = 100000;
+
+    juce::File directory;
+    bool enabled = false;
+
+    juce::CriticalSection lock;
+    juce::String processName{ "NN_Func" };
+    int processId = 1;
+    std::vector<Event> events;
+    std::map<juce::int64, juce::String> threadNames;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TraceRecorder)
+};
@@ -0,0 +1,63 @@
+/*
+  ==============================================================================
+
+    TripleBuffer.h
+
+    Lock-free single producer / single consumer hand-off of a fixed size
+    value. The producer fills its private slot and publishes it with one
+    atomic exchange, the consumer picks up the latest published slot with
+    another. Neither side ever waits for or allocates on behalf of the other,
+    so it is safe to read from the audio thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+
+template <typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer()
+	{
+	};
+
+	~TripleBuffer()
+	{
+	};
+
+	/** Producer side: the slot to fill before calling publish(). */
+	T& getWriteBuffer() noexcept                { return buffers[back]; }
+
+	/** Producer side: hands the filled slot to the consumer, an unread earlier value is dropped. */
+	void publish() noexcept
+	{
+		back = middle.exchange(back | dirtyFlag, std::memory_order_acq_rel) & indexMask;
+	}
+
+	/** Consumer side: makes the latest published value current, returns false if nothing new arrived. */
+	bool acquire() noexcept
+	{
+		if ((middle.load(std::memory_order_acquire) & dirtyFlag) == 0)
+			return false;
+
+		front = middle.exchange(front, std::memory_order_acq_rel) & indexMask;
+		return true;
+	}
+
+	/** Consumer side: the value made current by the last successful acquire(). */
+	const T& getReadBuffer() const noexcept     { return buffers[front]; }
+
+private:
+	enum { indexMask = 3, dirtyFlag = 4 };
+
+	T buffers[3];
+	std::atomic<int> middle{ 1 };
+	int back = 0;
+	int front = 2;
+
+	JUCE_DECLARE_NON_COPYABLE(TripleBuffer)
+};
@@ -0,0 +1,79 @@
+/*
+  ==============================================================================
+
+    WorkerSignal.cpp
+
+  ==============================================================================
+*/
+
+#include "WorkerSignal.h"
+
+#if JUCE_WINDOWS
+ #ifndef NOMINMAX
+  #define NOMINMAX
+ #endif
+ #include <windows.h>
+#elif JUCE_MAC || JUCE_IOS
+ #include <dispatch/dispatch.h>
+#else
+ #include <semaphore.h>
+ #include <cerrno>
+#endif
+
+//==============================================================================
+/** The system's own semaphore: posting it neither locks nor allocates, so the audio thread may do it. */
+struct WorkerSignal::Semaphore
+{
+   #if JUCE_WINDOWS
+	Semaphore() : handle(CreateSemaphoreW(nullptr, 0, 1, nullptr))    {}
+	~Semaphore()                                                         { CloseHandle(handle); }
+
+	void post() noexcept                                                 { ReleaseSemaphore(handle, 1, nullptr); }
+	void wait() noexcept                                                 { WaitForSingleObject(handle, INFINITE); }
+
+	HANDLE handle;
+   #elif JUCE_MAC || JUCE_IOS
+	Semaphore() : handle(dispatch_semaphore_create(0))                   {}
+	~Semaphore()                                                         { dispatch_release(handle); }
+
+	void post() noexcept                                                 { dispatch_semaphore_signal(handle); }
+	void wait() noexcept                                                 { dispatch_semaphore_wait(handle, DISPATCH_TIME_FOREVER); }
+
+	dispatch_semaphore_t handle;
+   #else
+	Semaphore()                                                          { sem_init(&handle, 0, 0); }
+	~Semaphore()                                                         { sem_destroy(&handle); }
+
+	void post() noexcept                                                 { sem_post(&handle); }
+
+	void wait() noexcept
+	{
+		// a signal handler interrupts the wait without a post
+		while (sem_wait(&handle) != 0 && errno == EINTR)
+		{
+		}
+	}
+
+	sem_t handle;
+   #endif
+};
+
+//==============================================================================
+WorkerSignal::WorkerSignal()
+	: semaphore(std::make_unique<Semaphore>())
+{
+}
+
+WorkerSignal::~WorkerSignal()
+{
+}
+
+void WorkerSignal::post() noexcept
+{
+	semaphore->post();
+}
+
+void WorkerSignal::sleep() noexcept
+{
+	semaphore->wait();
+}
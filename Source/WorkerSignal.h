@@ -0,0 +1,95 @@
+/*
+  ==============================================================================
+
+    WorkerSignal.h
+
+    Wakes a background thread from the audio thread without a lock. The
+    waiting thread spins for a few microseconds, which covers work that
+    follows right away, and then sleeps on a system semaphore. signal() is
+    an atomic operation while the thread is awake and only posts the
+    semaphore when the thread has gone to sleep.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <memory>
+
+#if JUCE_INTEL
+ #include <emmintrin.h>
+#endif
+
+class WorkerSignal
+{
+public:
+	WorkerSignal();
+	~WorkerSignal();
+
+	/** Any thread, including the audio thread. Signals that arrive while one is still
+		outstanding are merged into it, the waiter takes all the work it finds anyway.
+	*/
+	void signal() noexcept
+	{
+		auto state = count.load(std::memory_order_relaxed);
+		do
+		{
+			if (state > 0)
+				return;
+		}
+		while (!count.compare_exchange_weak(state, state + 1, std::memory_order_release, std::memory_order_relaxed));
+
+		if (state < 0)
+			post();
+	}
+
+	/** Returns once signal() was called since the last return. Only ever called by one thread,
+		which has to signal() after signalThreadShouldExit() to get it out of a sleeping wait.
+	*/
+	void wait() noexcept
+	{
+		const auto spinEnd = juce::Time::getHighResolutionTicks() + juce::Time::secondsToHighResolutionTicks(spinSeconds);
+
+		do
+		{
+			auto state = count.load(std::memory_order_relaxed);
+			if (state > 0 && count.compare_exchange_strong(state, 0, std::memory_order_acquire, std::memory_order_relaxed))
+				return;
+
+			pause();
+		}
+		while (juce::Time::getHighResolutionTicks() < spinEnd);
+
+		// -1 tells signal() that this thread sleeps and needs the semaphore
+		if (count.fetch_sub(1, std::memory_order_acquire) > 0)
+			return;
+
+		sleep();
+	}
+
+	/** Tells the core this is a spin-wait, e.g. while waiting for a worker that already runs the job. */
+	static void pause() noexcept
+	{
+	   #if JUCE_INTEL
+		_mm_pause();
+	   #elif JUCE_ARM && (JUCE_GCC || JUCE_CLANG)
+		__asm__ __volatile__ ("yield");
+	   #endif
+	}
+
+private:
+	struct Semaphore;
+
+	void post() noexcept;
+	void sleep() noexcept;
+
+	static constexpr double spinSeconds = 0.000005;
+
+	// 1 signalled, 0 nothing outstanding, -1 the waiter sleeps on the semaphore
+	std::atomic<int> count{ 0 };
+	std::unique_ptr<Semaphore> semaphore;
+
+	JUCE_DECLARE_NON_COPYABLE(WorkerSignal)
+};
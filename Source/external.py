@@ -6,6 +6,34 @@ from scipy.optimize import lsq_linear
 from DecayFitNet.python.toolbox.DecayFitNetToolbox import DecayFitNetToolbox
 import matplotlib.pyplot as plt
 import os
+import functools
+from contextlib import contextmanager
+
+
+class DecodeCancelled(Exception):
+    pass
+
+
+def report_progress(progress, stage, fraction):
+    # progress(stage, fraction) returns False when the caller wants the decode abandoned
+    if progress is not None and progress(stage, fraction) is False:
+        raise DecodeCancelled(stage)
+
+
+@contextmanager
+def trace(name, detail=''):
+    # span in the Chrome trace of the embedding process (NN_TRACE, see TraceRecorder.h), nothing outside the plugin
+    try:
+        import local_calc
+    except ImportError:
+        yield
+        return
+    start = local_calc.trace_now()
+    try:
+        yield
+    finally:
+        if start > 0:
+            local_calc.trace_span(name, start, detail)
 
 
 def mag2db(input_data):
@@ -166,56 +194,104 @@ def hertz2rad(freq, fs):
     return 2 * np.pi * np.array(freq) / fs
 
 
-def designGEQ(targetG: np.array):
-    fs = 48000
-    fftLen = 2 ** 16
-
-    centerFrequencies = [63, 125, 250, 500, 1000, 2000, 4000, 8000]  # Hz
-    ShelvingCrossover = [46, 11360]  # Hz
-    numFreq = len(centerFrequencies) + len(ShelvingCrossover)
-    shelvingOmega = hertz2rad(ShelvingCrossover, fs)
-    centerOmega = hertz2rad(centerFrequencies, fs)
-    R = 2.7
-
-    # control frequencies are spaced logarithmically
-    numControl = 100
-    controlFrequencies = np.round(np.logspace(np.log10(1), np.log10(fs / 2.1), numControl + 1))
-
-    # target magnitude response via command gains
-    targetF = [1] + centerFrequencies + [fs]
-    targetInterp = np.interp(controlFrequencies, targetF, targetG)
-
-    # design prototype of the biquad sections
-    prototypeGain = 10  # dB
-    prototypeGainArray = prototypeGain * np.ones(numFreq + 1)
-    prototypeSOS = graphicEQ(centerOmega, shelvingOmega, R, prototypeGainArray)
-    G, prototypeH, prototypeW = probeSOS(prototypeSOS, controlFrequencies, fftLen, fs)
-    G = G / prototypeGain  # dB vs control frequencies
-
-    # compute optimal parametric EQ gains
-    # Either you can use a unconstrained linear solver or introduce gain bounds
-    # at [-20dB,+20dB] with acceptable deviation from the self-similarity
-    # property. The plot shows the deviation between design curve and actual
-    # curve.
-    upperBound = np.append(np.inf, 2 * prototypeGain * np.ones(numFreq))
-    lowerBound = upperBound * -1
+def probeSOSAtControl(SOS, controlFrequencies, fftLen, fs):
+    # same dB values as probeSOS, but freqz is only evaluated at the two grid bins around each control frequency
+    binWidth = fs / (2 * fftLen)
+    bins = np.minimum(np.floor(controlFrequencies / binWidth).astype(int), fftLen - 2)
+    fraction = (controlFrequencies - bins * binWidth) / binWidth
+    grid = np.concatenate((bins, bins + 1)) * binWidth
+
+    G = np.zeros((len(controlFrequencies), SOS.shape[0]))
+    for band in range(SOS.shape[0]):
+        w, h = freqz(SOS[band, 0:3], SOS[band, 3:6], worN=grid, fs=fs)
+        lower, upper = np.split(20 * np.log10(np.abs(h)), 2)
+        G[:, band] = lower + fraction * (upper - lower)
+
+    return G
+
+
+class GEQPrototype:
+    # everything of designGEQ that does not depend on the target, see geqPrototype
+    def __init__(self, fs, centerFrequencies, shelvingCrossover, fftLen):
+        numFreq = len(centerFrequencies) + len(shelvingCrossover)
+        self.shelvingOmega = hertz2rad(shelvingCrossover, fs)
+        self.centerOmega = hertz2rad(centerFrequencies, fs)
+        self.R = 2.7
+
+        # control frequencies are spaced logarithmically
+        numControl = 100
+        self.controlFrequencies = np.round(np.logspace(np.log10(1), np.log10(fs / 2.1), numControl + 1))
+
+        # target magnitude response via command gains
+        self.targetF = [1] + list(centerFrequencies) + [fs]
+
+        # design prototype of the biquad sections
+        prototypeGain = 10  # dB
+        prototypeGainArray = prototypeGain * np.ones(numFreq + 1)
+        prototypeSOS = graphicEQ(self.centerOmega, self.shelvingOmega, self.R, prototypeGainArray)
+        self.G = probeSOSAtControl(prototypeSOS, self.controlFrequencies, fftLen, fs) / prototypeGain  # dB vs control frequencies
+        self.pseudoInverse = np.linalg.pinv(self.G)
+
+        # Either you can use a unconstrained linear solver or introduce gain bounds
+        # at [-20dB,+20dB] with acceptable deviation from the self-similarity
+        # property. The plot shows the deviation between design curve and actual
+        # curve.
+        self.upperBound = np.append(np.inf, 2 * prototypeGain * np.ones(numFreq))
+        self.lowerBound = self.upperBound * -1
+
+        for array in (self.controlFrequencies, self.G, self.pseudoInverse, self.upperBound, self.lowerBound):
+            array.setflags(write=False)
+
+
+@functools.lru_cache(maxsize=8)
+def geqPrototype(fs=48000, centerFrequencies=(63, 125, 250, 500, 1000, 2000, 4000, 8000), shelvingCrossover=(46, 11360), fftLen=2 ** 16):
+    # built once per interpreter, every design of every RIR reuses it
+    return GEQPrototype(fs, centerFrequencies, shelvingCrossover, fftLen)
+
+
+def designGEQBatch(targetGs):
+    # one cascade per row of targetGs (command gains in dB as for designGEQ), numDesigns x 11 x 6
+    prototype = geqPrototype()
+    targetInterp = np.stack([np.interp(prototype.controlFrequencies, prototype.targetF, targetG) for targetG in targetGs], axis=1)
 
     # matlab code
     # x    =    lsqlin(C, d, A, b, Aeq, beq, lb, ub, x0, options)
     # optG =    lsqlin(G, targetInterp, [], [], [], [], lowerBound, upperBound, [], opts)
 
-    optG = lsq_linear(G, targetInterp, bounds=(lowerBound, upperBound), method='bvls').x
-    sos = graphicEQ(centerOmega, shelvingOmega, R, optG)
-    return sos, targetF
+    # the unconstrained least squares solutions of all designs in one product; where one stays inside the bounds
+    # it is the bounded solution too, only designs that leave them go through bvls
+    optG = prototype.pseudoInverse @ targetInterp
+    outside = np.any((optG.T < prototype.lowerBound) | (optG.T > prototype.upperBound), axis=1)
+    for design in np.flatnonzero(outside):
+        optG[:, design] = lsq_linear(prototype.G, targetInterp[:, design], bounds=(prototype.lowerBound, prototype.upperBound),
+                                     method='bvls').x
+
+    return np.array([graphicEQ(prototype.centerOmega, prototype.shelvingOmega, prototype.R, gains) for gains in optG.T])
+
+
+def designGEQ(targetG: np.array):
+    return designGEQBatch([targetG])[0], geqPrototype().targetF
 
 
-def RIR2AbsCoefLvlCoef(data, delayLines, fs):
+def select_designGEQ():
+    # local_calc only exists inside the plugin's embedded interpreter, it carries the native designer
+    try:
+        import local_calc
+    except ImportError:
+        return designGEQBatch
+    return lambda targetGs: np.array([local_calc.designGEQ(list(targetG)) for targetG in targetGs])
+
+
+def RIR2AbsCoefLvlCoef(data, delayLines, fs, progress=None):
     n_slopes = 1
     filter_frequencies = [63, 125, 250, 500, 1000, 2000, 4000, 8000]
 
     # Prepare the model
-    net = DecayFitNetToolbox(n_slopes=n_slopes, sample_rate=fs, filter_frequencies=filter_frequencies)
-    est_parameters_net, norm_vals_net = net.estimate_parameters(data, analyse_full_rir=True)
+    report_progress(progress, 'analyzing', 0.0)
+    with trace('DecayFitNet model'):
+        net = DecayFitNetToolbox(n_slopes=n_slopes, sample_rate=fs, filter_frequencies=filter_frequencies)
+    with trace('DecayFitNet inference', '%d samples' % data.shape[0]):
+        est_parameters_net, norm_vals_net = net.estimate_parameters(data, analyse_full_rir=True)
     estT = est_parameters_net[0].T
     estA = est_parameters_net[1].T
     estN = est_parameters_net[2].T
@@ -227,17 +303,15 @@ def RIR2AbsCoefLvlCoef(data, delayLines, fs):
     # Convert T60 to magnitude response
     targetG = RT602slope(targetT60, fs)
 
-    output_data = np.zeros([len(delayLines) + 1, len(filter_frequencies) + 3, 6])
-
-    for index, delayLine in enumerate(delayLines):
-        sos, _ = designGEQ(delayLine * targetG)
-        output_data[index] = sos
-
     estLevel = np.hstack((estL[0, 0], estL[0], estL[0, -1]))
     targetLevel = mag2db(estLevel)
     targetLevel = targetLevel - np.array([0, 0, 0, 0, 0, 0, 0, 0, 0, 0])
-    sos, _ = designGEQ(targetLevel)
-    output_data[-1] = sos
+
+    # one absorption cascade per delay line and the transition cascade last, designed together
+    targets = [delayLine * targetG for delayLine in delayLines] + [targetLevel]
+    report_progress(progress, 'designing', 0.0)
+    with trace('designGEQ', '%d designs' % len(targets)):
+        output_data = select_designGEQ()(targets)
 
     return output_data
 
@@ -247,22 +321,162 @@ def compute_engery_scale(input_data):
     return 1 / np.max(np.abs(h))
 
 
-def RIR2FDN(f, ch1, ch2, ch3, ch4):
+def RIR2FDN(f, *delayLines, progress=None, rir=None, fs=None, scale=1.0):
+    # rir: first channel the plugin already read (SharedImpulseResponse), a read-only float32 view of its samples
+    # scaled by `scale` to wavio's full scale; the file is only read here when it is not given
     fp = f
-    file = wavio.read(fp)
-    data = file.data[:, 0] / (2 ** (file.sampwidth * 8 - 1) - 1)
-    fs = file.rate
+    report_progress(progress, 'reading', 0.0)
+    if rir is None:
+        with trace('wavio.read', fp):
+            file = wavio.read(fp)
+        data = file.data[:, 0] / (2 ** (file.sampwidth * 8 - 1) - 1)
+        fs = file.rate
+    else:
+        data = np.multiply(rir, scale, dtype=np.float64)
     # data_norm = data / np.linalg.norm(data)
-    delayLines = np.array([ch1, ch2, ch3, ch4])
-    output_data = RIR2AbsCoefLvlCoef(data, delayLines, fs)
-
-    return output_data.tolist()
+    # one absorption cascade per delay line, any number of lines
+    delayLines = np.array(delayLines)
+    output_data = RIR2AbsCoefLvlCoef(data, delayLines, fs, progress)
+    report_progress(progress, 'done', 1.0)
+
+    # handed to C++ through the buffer protocol, keep it a contiguous float64 (lines + 1) x 11 x 6 block
+    return np.ascontiguousarray(output_data, dtype=np.float64)
+
+
+def save_coefficients(path, output_data):
+    # text layout read by CoefficientTensor::loadFromText, e.g. for the NN_Render command line tool
+    np.savetxt(path, np.asarray(output_data, dtype=np.float64).reshape(-1, 6), fmt='%.17g')
+
+
+def export_decayfitnet_weights(path, n_slopes=1, filter_frequencies=(63, 125, 250, 500, 1000, 2000, 4000, 8000),
+                               reference_seconds=10.0):
+    # one-off conversion of the toolbox's network for the native DecayFitNet (DecayFitNet.h), needs PyTorch once.
+    # Put the file next to external.py as DecayFitNet.weights and decodes no longer start Python.
+    import struct
+    import torch
+
+    toolbox = DecayFitNetToolbox(n_slopes=n_slopes, sample_rate=48000, filter_frequencies=list(filter_frequencies))
+    model = next(v for v in vars(toolbox).values() if isinstance(v, torch.nn.Module)).eval()
+    transform = next(v for v in vars(toolbox).values() if isinstance(v, dict) and 'edcs_db_normfactor' in v)
+    input_length = next(v for k, v in vars(toolbox).items() if k.lstrip('_') == 'output_size')
+
+    # layer records of DecayFitNet::readStack, the order of DecayFitNetLinear.forward; dropout is a no-op at inference
+    relu = struct.pack('<if', 3, model.activation.negative_slope)
+
+    def conv(layer):
+        weights = layer.weight.detach().numpy().astype('<f4')
+        return (struct.pack('<iiiii', 1, layer.in_channels, layer.out_channels, layer.kernel_size[0], layer.padding[0])
+                + weights.tobytes() + layer.bias.detach().numpy().astype('<f4').tobytes())
+
+    def linear(layer):
+        return (struct.pack('<iii', 2, layer.in_features, layer.out_features)
+                + layer.weight.detach().numpy().astype('<f4').tobytes() + layer.bias.detach().numpy().astype('<f4').tobytes())
+
+    def pool(layer):
+        size = layer.kernel_size
+        return struct.pack('<ii', 4, size if isinstance(size, int) else size[0])
+
+    def square_plus(offset):
+        return struct.pack('<if', 5, offset)
+
+    trunk = [conv(model.conv1), relu, pool(model.maxpool1),
+             conv(model.conv2), relu, pool(model.maxpool2),
+             conv(model.conv3), relu, pool(model.maxpool3),
+             linear(model.input), relu]
+    for layer in model.linears:
+        trunk += [linear(layer), relu]
+
+    stacks = [trunk,
+              [linear(model.final1_t), relu, linear(model.final2_t), square_plus(0.01)],
+              [linear(model.final1_a), relu, linear(model.final2_a), square_plus(1e-16)],
+              [linear(model.final1_n), relu, linear(model.final2_n)]]
+    if hasattr(model, 'final1_n_slopes'):
+        stacks.append([linear(model.final1_n_slopes), relu, linear(model.final2_n_slopes)])
+
+    with open(path, 'wb') as f:
+        f.write(b'DFNW')
+        f.write(struct.pack('<iiiffi', 1, input_length, n_slopes, transform['edcs_db_normfactor'], reference_seconds,
+                            len(filter_frequencies)))
+        f.write(np.asarray(filter_frequencies, dtype='<f4').tobytes())
+        f.write(struct.pack('<i', len(stacks)))
+        for stack in stacks:
+            f.write(struct.pack('<i', len(stack)))
+            for record in stack:
+                f.write(record)
 
 
 def demo_RIR2FDN():	
     fp = "C:\\Python37\\Lib\\DecayFitNet\\data\\exampleRIRs\\singleslope_00006_sh_rirs.wav"
-    output_data = RIR2FDN(fp, 1021, 2029, 3001, 4093)
-    return np.array(output_data)
+    return RIR2FDN(fp, 1021, 2029, 3001, 4093)
+
+
+def demo_compare_designGEQ(trials=20):
+    # run inside the plugin's interpreter, checks the native designer against designGEQ and times both
+    import time
+    import local_calc
+
+    rng = np.random.default_rng(0)
+    maxError = 0.0
+    pythonTime = 0.0
+    nativeTime = 0.0
+    targetGs = []
+    natives = []
+    for _ in range(trials):
+        targetG = rng.uniform(-30, 0, 10)
+
+        start = time.perf_counter()
+        sos, _ = designGEQ(targetG)
+        pythonTime += time.perf_counter() - start
+
+        start = time.perf_counter()
+        native = np.array(local_calc.designGEQ(list(targetG)))
+        nativeTime += time.perf_counter() - start
+
+        maxError = max(maxError, np.max(np.abs(sos - native)))
+        targetGs.append(targetG)
+        natives.append(native)
+
+    # designGEQ only ever hands designGEQBatch one design, all of them at once take the other columns of the batch
+    maxError = max(maxError, np.max(np.abs(designGEQBatch(targetGs) - np.array(natives))))
+
+    print('max coefficient error: ', maxError)
+    print('python designGEQ [ms]: ', pythonTime / trials * 1e3)
+    print('native designGEQ [ms]: ', nativeTime / trials * 1e3)
+
+    # the two solvers round differently on the ill-conditioned interaction matrix, which costs up to about 2e-9 on
+    # coefficients of order 1; a wrong prototype, bound or biquad formula is off by far more
+    assert maxError < 1e-8, 'native designGEQ differs from the Python design by %g' % maxError
+    return maxError
+
+
+def demo_compare_decayFitNet(fp, weights, n_slopes=1):
+    # run inside the plugin's interpreter, checks the native DecayFitNet against the toolbox on one RIR and times both
+    import time
+    import local_calc
+
+    file = wavio.read(fp)
+    data = file.data[:, 0] / (2 ** (file.sampwidth * 8 - 1) - 1)
+    filter_frequencies = [63, 125, 250, 500, 1000, 2000, 4000, 8000]
+
+    start = time.perf_counter()
+    net = DecayFitNetToolbox(n_slopes=n_slopes, sample_rate=file.rate, filter_frequencies=filter_frequencies)
+    (T, A, N), norm = net.estimate_parameters(data, analyse_full_rir=True)
+    pythonTime = time.perf_counter() - start
+
+    start = time.perf_counter()
+    nativeT, nativeA, nativeN, nativeNorm = local_calc.estimateDecay(weights, data.astype(np.float32), file.rate)
+    nativeTime = time.perf_counter() - start
+
+    def relative(a, b):
+        a = np.asarray(a, dtype=np.float64).reshape(-1)
+        b = np.asarray(b, dtype=np.float64).reshape(-1)
+        return np.max(np.abs(a - b) / np.maximum(np.abs(b), 1e-12))
+
+    errors = {'T': relative(nativeT, T), 'A': relative(nativeA, A), 'N': relative(nativeN, N), 'norm': relative(nativeNorm, norm)}
+    print('max relative error: ', errors)
+    print('toolbox [ms]: ', pythonTime * 1e3)
+    print('native [ms]: ', nativeTime * 1e3)
+    return errors
 
 
 def demo_decayFitNet2InitialLevel():
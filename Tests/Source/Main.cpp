@@ -0,0 +1,128 @@
+/*
+  ==============================================================================
+
+    NN_Tests: tests that need more than the plugin binary, run from the
+    command line.
+
+    NN_Tests [path to NN_Worker]
+
+    The coefficient worker test launches NN_Worker as a stand-in, so neither
+    Python nor DecayFitNet is needed. Without a path the worker is expected
+    next to NN_Tests, where the plugin looks for it too. Exits with 1 when
+    any test fails.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/CoefficientWorkerClient.h"
+
+//==============================================================================
+class CoefficientWorkerClientTest : public juce::UnitTest
+{
+public:
+    explicit CoefficientWorkerClientTest(const juce::File& workerExecutable)
+        : juce::UnitTest("CoefficientWorkerClient", "NN"),
+          executable(workerExecutable)
+    {
+    }
+
+    void runTest() override
+    {
+        beginTest("The stand-in answers a job");
+        if (!executable.existsAsFile())
+        {
+            expect(false, "no NN_Worker at " + executable.getFullPathName());
+            return;
+        }
+
+        {
+            // the job outlives the client, whose last callbacks may still be queued
+            Job job;
+            CoefficientWorkerClient client(executable, true);
+            expect(submit(client, job));
+            expect(waitFor([&job] { return job.numResults > 0; }), "no result");
+            expect(job.coefficients.isValid());
+            expect(job.status->state == RIRDecodeJob::State::done);
+            expectEquals(client.getNumRestarts(), 0);
+        }
+
+        beginTest("A worker killed mid-job is relaunched and gets the job again");
+        {
+            Job job;
+            CoefficientWorkerClient client(executable, true);
+            expect(submit(client, job));
+
+            // progress only comes from a worker that holds the job
+            expect(waitFor([&job] { return job.status->state == RIRDecodeJob::State::analyzing; }), "no progress");
+            expectEquals(job.numResults, 0);
+            client.killWorkerForTesting();
+
+            expect(waitFor([&client] { return client.getNumRestarts() == 1 && client.isRunning(); }), "not relaunched");
+            expect(waitFor([&job] { return job.numResults > 0; }), "no result after the relaunch");
+            expect(job.coefficients.isValid());
+            expect(job.status->state == RIRDecodeJob::State::done);
+
+            // the killed worker never answers, so the job finishes once, and a result clears the restarts
+            waitFor([] { return false; }, 200);
+            expectEquals(job.numResults, 1);
+            expectEquals(client.getNumRestarts(), 0);
+        }
+    }
+
+private:
+    struct Job
+    {
+        std::shared_ptr<RIRDecodeJob::Status> status = std::make_shared<RIRDecodeJob::Status>();
+        FilterCoefficientSet coefficients;
+        int numResults = 0;
+    };
+
+    static bool submit(CoefficientWorkerClient& client, Job& job)
+    {
+        // the stand-in only looks at the delay lines
+        return client.submit(juce::File(), {}, std::vector<float>(delaySize, 2003.0f), job.status,
+                             [&job](const FilterCoefficientSet& coefficients, std::shared_ptr<const SharedImpulseResponse>)
+                             {
+                                 job.coefficients = coefficients;
+                                 ++job.numResults;
+                             });
+    }
+
+    // results and relaunches arrive through the message loop, so it runs while waiting
+    template <typename Condition>
+    static bool waitFor(Condition&& isDone, int timeoutMilliseconds = 20000)
+    {
+        const auto end = juce::Time::getMillisecondCounter() + (juce::uint32)timeoutMilliseconds;
+        while (!isDone())
+        {
+            if (juce::Time::getMillisecondCounter() >= end)
+                return false;
+
+            juce::MessageManager::getInstance()->runDispatchLoopUntil(10);
+        }
+        return true;
+    }
+
+    juce::File executable;
+};
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    const auto worker = argc > 1 ? juce::File::getCurrentWorkingDirectory().getChildFile(argv[1])
+                                 : CoefficientWorkerClient::getDefaultExecutable();
+
+    CoefficientWorkerClientTest workerTest(worker);
+
+    juce::UnitTestRunner runner;
+    runner.runTests(juce::Array<juce::UnitTest*>{ &workerTest });
+
+    int failures = 0;
+    for (int i = 0; i < runner.getNumResults(); i++)
+        failures += runner.getResult(i)->failures;
+
+    return failures > 0 ? 1 : 0;
+}
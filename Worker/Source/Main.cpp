@@ -0,0 +1,230 @@
+/*
+  ==============================================================================
+
+    NN_Worker: out-of-process RIR2FDN coefficient designer.
+
+    Launched by CoefficientWorkerClient through juce::ChildProcessCoordinator.
+    Requests are decoded with the same RIRDecodeJob the plugin runs in-process,
+    progress is reported back over the pipe, and the worker quits as soon as
+    its plugin goes away. Started with the stand-in id it skips Python and
+    answers every request with fixed flat coefficients, which is enough to
+    exercise the plugin side without DecayFitNet installed. It holds each
+    answer back for a moment and reports progress meanwhile, like a decode,
+    so tests can interrupt a job.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/CoefficientWorkerProtocol.h"
+#include "../../Source/RIRDecodeJob.h"
+#include "../../Source/TraceRecorder.h"
+
+//==============================================================================
+class CoefficientDesignWorker : public juce::ChildProcessWorker,
+                                private juce::Timer
+{
+public:
+    explicit CoefficientDesignWorker(bool useStandIn) : standIn(useStandIn)
+    {
+    }
+
+    ~CoefficientDesignWorker() override
+    {
+        stopTimer();
+        // no timeout, a job still running would call back into this object
+        decodePool.removeAllJobs(true, -1);
+    }
+
+    void handleConnectionMade() override
+    {
+    }
+
+    void handleConnectionLost() override
+    {
+        // nobody is left to receive results
+        juce::MessageManager::getInstance()->stopDispatchLoop();
+    }
+
+    void handleMessageFromCoordinator(const juce::MemoryBlock& message) override
+    {
+        using namespace CoefficientWorkerProtocol;
+
+        juce::MemoryInputStream stream(message, false);
+        juce::int64 jobId = 0;
+        const auto type = readHeader(stream, jobId);
+
+        if (type == MessageType::request)
+        {
+            auto request = readRequest(stream, jobId);
+            // Python is started and driven from the message thread, not the pipe thread
+            juce::MessageManager::callAsync([this, request] { startJob(request); });
+        }
+        else if (type == MessageType::cancel)
+        {
+            const juce::ScopedLock sl(jobsLock);
+            auto job = jobs.find(jobId);
+            if (job != jobs.end())
+                job->second->cancelRequested = true;
+        }
+    }
+
+private:
+    void startJob(const CoefficientWorkerProtocol::Request& request)
+    {
+        using namespace CoefficientWorkerProtocol;
+
+        if (standIn)
+        {
+            startStandInJob(request);
+            return;
+        }
+
+        if (request.delayLines.size() != delaySize)
+        {
+            sendMessageToCoordinator(writeResult(request.jobId, ResultCode::failed, FilterCoefficientSet()));
+            return;
+        }
+
+        if (!RIRDecodeJob::canDecodeNatively(request.scriptDirectory))
+            python.startIfNeeded();
+
+        auto status = std::make_shared<RIRDecodeJob::Status>();
+        {
+            const juce::ScopedLock sl(jobsLock);
+            jobs[request.jobId] = status;
+        }
+
+        const auto jobId = request.jobId;
+        auto callback = [this, jobId](const FilterCoefficientSet& coefficients, std::shared_ptr<const SharedImpulseResponse>)
+        {
+            sendMessageToCoordinator(writeResult(jobId, ResultCode::ok, coefficients));
+            removeJob(jobId);
+        };
+
+        decodePool.addJob(new RIRDecodeJob(&python, juce::File(request.rirPath), request.scriptDirectory, request.delayLines,
+                                           status, std::move(callback)), true);
+        startTimerHz(10);
+    }
+
+    void startStandInJob(const CoefficientWorkerProtocol::Request& request)
+    {
+        using namespace CoefficientWorkerProtocol;
+
+        auto status = std::make_shared<RIRDecodeJob::Status>();
+        status->state = RIRDecodeJob::State::analyzing;
+        {
+            const juce::ScopedLock sl(jobsLock);
+            jobs[request.jobId] = status;
+        }
+
+        // the timer reports progress until the answer goes out
+        juce::Timer::callAfterDelay(standInMilliseconds, [this, jobId = request.jobId, status, coefficients = makeStandInCoefficients(request.delayLines)]
+        {
+            if (status->cancelRequested)
+                sendMessageToCoordinator(writeResult(jobId, ResultCode::cancelled, FilterCoefficientSet()));
+            else
+                sendMessageToCoordinator(writeResult(jobId, ResultCode::ok, coefficients));
+
+            status->state = RIRDecodeJob::State::done;
+            removeJob(jobId);
+        });
+        startTimerHz(10);
+    }
+
+    static FilterCoefficientSet makeStandInCoefficients(const std::vector<float>& delayLines)
+    {
+        // a plain broadband gain per line, decaying a little faster for longer lines, and a flat transition EQ
+        FilterCoefficientSet coefficients;
+        for (int row = 0; row < FilterCoefficientSet::numRows; row++)
+        {
+            const auto delay = row < (int)delayLines.size() ? delayLines[(size_t)row] : 0.0f;
+            for (int band = 0; band < FilterCoefficientSet::bands; band++)
+            {
+                auto* section = coefficients.section(row, band);
+                const double gain = (band == 0 && row < delaySize) ? std::pow(10.0, -3.0 * delay / 48000.0) : 1.0;
+                const double values[] = { gain, 0.0, 0.0, 1.0, 0.0, 0.0 };
+                std::copy(std::begin(values), std::end(values), section);
+            }
+        }
+        return coefficients;
+    }
+
+    void removeJob(juce::int64 jobId)
+    {
+        {
+            const juce::ScopedLock sl(jobsLock);
+            jobs.erase(jobId);
+        }
+
+        // NN_Worker.json next to the plugin's trace, on the same clock
+        TraceRecorder::getInstance().write();
+    }
+
+    void timerCallback() override
+    {
+        using namespace CoefficientWorkerProtocol;
+
+        std::vector<std::pair<juce::int64, std::shared_ptr<RIRDecodeJob::Status>>> snapshot;
+        {
+            const juce::ScopedLock sl(jobsLock);
+            snapshot.assign(jobs.begin(), jobs.end());
+        }
+
+        for (auto& job : snapshot)
+        {
+            const auto state = job.second->state.load();
+
+            // done is answered by the job callback with the coefficients themselves
+            if (state == RIRDecodeJob::State::failed || state == RIRDecodeJob::State::cancelled)
+            {
+                const auto code = state == RIRDecodeJob::State::failed ? ResultCode::failed : ResultCode::cancelled;
+                sendMessageToCoordinator(writeResult(job.first, code, FilterCoefficientSet()));
+                removeJob(job.first);
+            }
+            else if (state != RIRDecodeJob::State::done)
+            {
+                sendMessageToCoordinator(writeProgress(job.first, (int)state, job.second->progress.load()));
+            }
+        }
+
+        if (snapshot.empty())
+            stopTimer();
+    }
+
+    // how long the stand-in takes for a job
+    static constexpr int standInMilliseconds = 1000;
+
+    bool standIn;
+    PythonInterpreter python;
+    juce::ThreadPool decodePool{ 1 };
+
+    juce::CriticalSection jobsLock;
+    std::map<juce::int64, std::shared_ptr<RIRDecodeJob::Status>> jobs;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (CoefficientDesignWorker)
+};
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::StringArray arguments(argv + 1, argc - 1);
+    const auto commandLine = arguments.joinIntoString(" ");
+
+    // the coordinator picks the flavour through the id it launches us with
+    const bool standIn = commandLine.contains(CoefficientWorkerProtocol::standInCommandLineUID);
+    CoefficientDesignWorker worker(standIn);
+    TraceRecorder::getInstance().setProcessName("NN_Worker", 2);
+
+    if (!worker.initialiseFromCommandLine(commandLine, standIn ? CoefficientWorkerProtocol::standInCommandLineUID
+                                                               : CoefficientWorkerProtocol::workerCommandLineUID))
+    {
+        std::cerr << "NN_Worker is launched by the NN_Function plugin" << std::endl;
+        return 1;
+    }
+
+    juce::MessageManager::getInstance()->runDispatchLoop();
+    return 0;
+}